@@ -0,0 +1,213 @@
+#include "pch.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "database.h"
+#include "location.h"
+#include "main_window.h"
+#include "territory.h"
+#include "text_format.h"
+#include "trains.h"
+
+using trainlist8::MainWindow;
+
+namespace {
+// The number of calls to operator new since the program started.
+std::atomic<uint64_t> allocationCount;
+
+// The number of bytes requested from operator new since the program started.
+std::atomic<uint64_t> allocationBytes;
+
+// The seed for every random input, so that each run measures the same work.
+constexpr unsigned int seed = 8;
+
+// The number of block IDs that the lookup benchmarks cycle through.
+constexpr size_t blockCount = 4096;
+
+// The number of trains in the sorted insertion and expiry sweep benchmarks, which is about what a busy set of servers carries.
+constexpr size_t trainCount = 2000;
+
+// The number of servers the trains in the expiry sweep benchmark are spread over.
+constexpr size_t serverCount = 4;
+
+// Runs a benchmark and prints how long one operation took and how many allocations it made, on average.
+//
+// The body is called with the index of each operation. It is run once untimed first, so that buffers and caches have settled.
+template<typename F>
+void run(const char *name, size_t operations, F &&body) {
+	body(size_t{0});
+	uint64_t startCount = allocationCount.load(std::memory_order_relaxed);
+	uint64_t startBytes = allocationBytes.load(std::memory_order_relaxed);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i != operations; ++i) {
+		body(i);
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	double count = static_cast<double>(operations);
+	double nanoseconds = std::chrono::duration<double, std::nano>(end - start).count();
+	std::printf("%s,%zu,%.1f,%.2f,%.1f\n", name, operations, nanoseconds / count, static_cast<double>(allocationCount.load(std::memory_order_relaxed) - startCount) / count, static_cast<double>(allocationBytes.load(std::memory_order_relaxed) - startBytes) / count);
+}
+
+// Generates block IDs like those in update messages: mostly blocks in territories the database knows, some in territories it does not, and some unsignalled locations.
+std::vector<int32_t> makeBlocks(std::mt19937 &rng) {
+	std::span<const trainlist8::database::Territory> territories = trainlist8::database::current().territories();
+	std::uniform_int_distribution<size_t> territoryDist(0, territories.empty() ? 0 : territories.size() - 1);
+	std::uniform_int_distribution<int32_t> kindDist(0, 19), suffixDigitsDist(1, 4);
+	std::vector<int32_t> blocks;
+	blocks.reserve(blockCount);
+	while(blocks.size() != blockCount) {
+		int32_t kind = kindDist(rng);
+		if(kind == 0) {
+			blocks.push_back(-1);
+			continue;
+		}
+		int32_t prefix = kind == 1 || territories.empty() ? 999 : static_cast<int32_t>(territories[territoryDist(rng)].id);
+		int32_t scale = 1;
+		for(int32_t digits = suffixDigitsDist(rng); digits; --digits) {
+			scale *= 10;
+		}
+		blocks.push_back(prefix * scale + std::uniform_int_distribution<int32_t>(0, scale - 1)(rng));
+	}
+	return blocks;
+}
+
+// Generates a train with random values in the columns that the benchmarks sort by.
+MainWindow::TrainInfo makeTrain(std::mt19937 &rng, const std::vector<int32_t> &blocks, size_t server, uint32_t id) {
+	static constexpr std::array<const wchar_t *, 6> symbolPrefixes{L"Q", L"M", L"S", L"G", L"U", L"Z"};
+	MainWindow::TrainInfo train{};
+	train.server = server;
+	train.id = id;
+	train.symbol = symbolPrefixes[std::uniform_int_distribution<size_t>(0, symbolPrefixes.size() - 1)(rng)];
+	train.symbol += std::to_wstring(std::uniform_int_distribution<uint32_t>(100, 999)(rng));
+	train.speed = std::uniform_int_distribution<int>(0, 70)(rng);
+	train.block = blocks[std::uniform_int_distribution<size_t>(0, blocks.size() - 1)(rng)];
+	train.territory = trainlist8::territory::idByBlock(train.block);
+	train.sortKey = trainlist8::trains::sortKey(train);
+	return train;
+}
+
+// Compares two trains the way the list does when it is sorted by descending speed, the column a busy dispatcher most often sorts by.
+bool trainBefore(const MainWindow::TrainInfo *x, const MainWindow::TrainInfo *y) {
+	if(x->speed != y->speed) {
+		return x->speed > y->speed;
+	}
+	return trainlist8::trains::compareTies(*x, *y) < 0;
+}
+}
+
+// Counts each allocation before passing it to malloc.
+void *operator new(size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	allocationBytes.fetch_add(size, std::memory_order_relaxed);
+	if(void *ret = std::malloc(size ? size : 1); ret) {
+		return ret;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	std::free(p);
+}
+
+// Measures the formatting and bookkeeping that each train update and simulation state message costs on the UI thread.
+//
+// The location database is loaded from locations.bin next to the executable. Every other input is generated from a fixed seed. Each line of the output gives the benchmark name, the number of operations, and the average nanoseconds, allocations and bytes allocated per operation.
+int main() {
+	trainlist8::database::load(trainlist8::database::defaultPath());
+	std::mt19937 rng(seed);
+	std::vector<int32_t> blocks = makeBlocks(rng);
+	std::printf("Benchmark,Operations,Nanoseconds,Allocations,Bytes\n");
+
+	run("territory::idByBlock", 1000000, [&blocks](size_t i) {
+		volatile bool found = trainlist8::territory::idByBlock(blocks[i % blockCount]).has_value();
+		static_cast<void>(found);
+	});
+
+	run("location::nameByBlock", 1000000, [&blocks](size_t i) {
+		volatile bool found = trainlist8::location::nameByBlock(blocks[i % blockCount]).has_value();
+		static_cast<void>(found);
+	});
+
+	{
+		std::vector<uint32_t> weights(blockCount);
+		std::ranges::generate(weights, [&rng]() { return std::uniform_int_distribution<uint32_t>(500, 20000)(rng); });
+		trainlist8::text_format::ScratchBuffers scratch;
+		run("formatNumber<uint32_t>", 200000, [&weights, &scratch](size_t i) {
+			trainlist8::text_format::formatNumber(weights[i % blockCount], scratch, 0);
+		});
+	}
+
+	{
+		std::vector<float> ratios(blockCount);
+		std::ranges::generate(ratios, [&rng]() { return std::uniform_real_distribution<float>(0.5f, 6.0f)(rng); });
+		trainlist8::text_format::ScratchBuffers scratch;
+		run("formatNumber<float>", 200000, [&ratios, &scratch](size_t i) {
+			trainlist8::text_format::formatNumber(ratios[i % blockCount], scratch, 1);
+		});
+	}
+
+	{
+		static constexpr std::array<const wchar_t *, 5> initials{L"BNSF", L"UP", L"CSXT", L"NS", L"ATSF"};
+		std::vector<uint32_t> numbers(blockCount);
+		std::ranges::generate(numbers, [&rng]() { return std::uniform_int_distribution<uint32_t>(1, 9999)(rng); });
+		std::wstring leadUnit;
+		run("text_format::leadUnit", 200000, [&numbers, &leadUnit](size_t i) {
+			leadUnit = trainlist8::text_format::leadUnit(initials[i % initials.size()], numbers[i % blockCount]);
+		});
+	}
+
+	{
+		// Each operation inserts one train into a list that is cleared whenever it fills up, as happens when the first trains arrive from every server.
+		std::vector<MainWindow::TrainInfo> trains;
+		trains.reserve(trainCount);
+		for(uint32_t i = 0; i != trainCount; ++i) {
+			trains.push_back(makeTrain(rng, blocks, i % serverCount, i));
+		}
+		std::vector<const MainWindow::TrainInfo *> order;
+		order.reserve(trainCount);
+		run("sorted insertion", trainCount * 100, [&trains, &order](size_t i) {
+			if(order.size() == trainCount) {
+				order.clear();
+			}
+			const MainWindow::TrainInfo *train = &trains[i % trainCount];
+			order.insert(std::ranges::lower_bound(order, train, trainBefore), train);
+		});
+	}
+
+	{
+		// Each operation is one simulation state message from one server. Trains start at staggered ages, so each sweep expires about a sixth of that server's trains, which are then added again as if they had reappeared, so the map stays the same size.
+		std::unordered_map<uint64_t, MainWindow::TrainInfo> trains;
+		for(uint32_t i = 0; i != trainCount; ++i) {
+			MainWindow::TrainInfo train = makeTrain(rng, blocks, i % serverCount, i);
+			train.age = i / serverCount % (trainlist8::trains::ageThreshold + 1);
+			trains.emplace((static_cast<uint64_t>(train.server) << 32) | train.id, std::move(train));
+		}
+		std::vector<MainWindow::TrainInfo> expired;
+		expired.reserve(trainCount);
+		run("expiry sweep", 100000, [&trains, &expired](size_t i) {
+			trainlist8::trains::age(trains, i % serverCount, 1, [&expired](MainWindow::TrainInfo &train) {
+				expired.push_back(std::move(train));
+			});
+			for(MainWindow::TrainInfo &train : expired) {
+				train.age = 0;
+				trains.emplace((static_cast<uint64_t>(train.server) << 32) | train.id, std::move(train));
+			}
+			expired.clear();
+		});
+	}
+
+	return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "connection.h"
 #include "error.h"
 #include "soap.h"
+#include "throughput.h"
 
 namespace error = trainlist8::error;
 namespace soap = trainlist8::soap;
@@ -13,9 +14,18 @@ namespace util = trainlist8::util;
 using trainlist8::Connection;
 
 namespace {
+// How much memory a heap keeps when it is reset, in bytes.
+//
+// This is enough for a typical batch of messages, so that once decoding reaches a steady state, resetting a heap just rewinds it instead of handing its memory back to the system only to ask for it again.
+constexpr size_t heapTrimSize = 256 * 1024;
+
+// The most messages that are decoded into the heap before it is reset, counting those that are discarded. A batch normally ends sooner, at each simulation state message (see endBatch); this bounds the heap if those stop arriving while other messages keep coming.
+constexpr unsigned int batchLimit = 256;
+
+// Create a heap.
 std::unique_ptr<WS_HEAP, util::HeapDeleter> createHeap() {
 	WS_HEAP *raw;
-	winrt::check_hresult(WsCreateHeap(std::numeric_limits<size_t>::max(), 0, nullptr, 0, &raw, nullptr));
+	winrt::check_hresult(WsCreateHeap(std::numeric_limits<size_t>::max(), heapTrimSize, nullptr, 0, &raw, nullptr));
 	return std::unique_ptr<WS_HEAP, util::HeapDeleter>(raw, util::HeapDeleter());
 }
 // Create a channel.
@@ -37,18 +47,51 @@ std::unique_ptr<WS_MESSAGE, util::MessageDeleter> createMessage(WS_CHANNEL *chan
 //
 // The connect function must be called before this object can be used to receive messages.
 Connection::Connection() :
+	hostname_(),
 	heap(createHeap()),
+	batchSize(0),
 	channel(createChannel()),
 	message(createMessage(channel.get())),
 	adapter(),
-	lastMessage_() {
+	lastMessage_(),
+	lastMessageTimestamps_(),
+	trackState() {
 }
 
 // Connects to the Run 8 instance running on the specified computer.
+//
+// This must only be called once, before the hostname is read from any other thread; reconnect is used to connect again.
 winrt::Windows::Foundation::IAsyncAction Connection::connect(winrt::hstring hostname) {
 	auto cancelToken = co_await winrt::get_cancellation_token();
 	cancelToken.enable_propagation();
 
+	// Remember the hostname in case the connection needs to be re-established later.
+	hostname_ = std::move(hostname);
+	co_await open();
+}
+
+// Discards the current channel, which has presumably failed, and connects again to the Run 8 instance passed to connect.
+//
+// The track state is kept, so that the full-state messages Run 8 sends after the new connection is established are reported as changes only where something actually changed while disconnected. Every previously received message is discarded.
+//
+// This may run on any thread. It never writes the hostname, so the UI thread can go on reading it meanwhile.
+winrt::Windows::Foundation::IAsyncAction Connection::reconnect() {
+	auto cancelToken = co_await winrt::get_cancellation_token();
+	cancelToken.enable_propagation();
+
+	lastMessage_.reset();
+	message.reset();
+	channel = createChannel();
+	message = createMessage(channel.get());
+	endBatch();
+	co_await open();
+}
+
+// Opens the channel to the Run 8 instance named by hostname_ and performs the dispatcher handshake.
+winrt::Windows::Foundation::IAsyncAction Connection::open() {
+	auto cancelToken = co_await winrt::get_cancellation_token();
+	cancelToken.enable_propagation();
+
 	// Build a URL.
 	std::wstring url;
 	{
@@ -57,7 +100,7 @@ winrt::Windows::Foundation::IAsyncAction Connection::connect(winrt::hstring host
 		static constinit const std::wstring_view path = L"/Run8";
 		WS_NETTCP_URL urlStruct = {
 			.url = {.scheme = WS_URL_NETTCP_SCHEME_TYPE},
-			.host = {.length = hostname.size(), .chars = const_cast<wchar_t *>(hostname.data())},
+			.host = {.length = hostname_.size(), .chars = const_cast<wchar_t *>(hostname_.data())},
 			.port = 15192,
 			.portAsString = {.length = portString.size(), .chars = const_cast<wchar_t *>(portString.data())},
 			.path = {.length = path.size(), .chars = const_cast<wchar_t *>(path.data())},
@@ -71,6 +114,7 @@ winrt::Windows::Foundation::IAsyncAction Connection::connect(winrt::hstring host
 	}
 
 	// Connect to Run8.
+	soap::startSession();
 	WS_ENDPOINT_ADDRESS endpoint{
 		.url = {
 			.length = url.size(),
@@ -101,7 +145,16 @@ winrt::Windows::Foundation::IAsyncAction Connection::connect(winrt::hstring host
 	}
 }
 
-// Waits until the next TrainData message is received from the connected Run 8 instance.
+// Returns the name of the computer Run 8 is running on, as passed to connect.
+const winrt::hstring &Connection::hostname() const {
+	return hostname_;
+}
+
+// Waits until the next SimulationState or TrainData message is received from the connected Run 8 instance.
+//
+// Track state messages are applied to the track state and counted here, rather than being returned, as nothing displays them yet.
+//
+// The message is decoded into the heap alongside the rest of the current batch. Every message received counts towards the batch, including those discarded here, and once batchLimit have been received the heap is reset before the next one; see endBatch.
 winrt::Windows::Foundation::IAsyncAction Connection::receiveMessage() {
 	auto cancelToken = co_await winrt::get_cancellation_token();
 	cancelToken.enable_propagation();
@@ -110,7 +163,11 @@ winrt::Windows::Foundation::IAsyncAction Connection::receiveMessage() {
 		// Clean up any previous message.
 		lastMessage_.reset();
 		winrt::check_hresult(WsResetMessage(message.get(), nullptr));
-		winrt::check_hresult(WsResetHeap(heap.get(), nullptr));
+
+		// Nothing received earlier may be used any more, so if the batch is full, start another. This also covers long runs of discarded messages, which never return to the caller.
+		if(batchSize >= batchLimit) {
+			endBatch();
+		}
 
 		// Receive some kind of message.
 		static constinit std::array descriptionPointers = {
@@ -120,19 +177,24 @@ winrt::Windows::Foundation::IAsyncAction Connection::receiveMessage() {
 			&soap::updateTrainDataMessage,
 			// Index 2 is permission update.
 			&soap::permissionUpdateMessage,
-			// Indices 3+ are ignored.
-			&soap::dtmfMessage,
-			&soap::radioTextMessage,
-			&soap::setInterlockErrorSwitchesMessage,
+			// Indices 3 through 7 are track state.
 			&soap::setOccupiedBlocksMessage,
 			&soap::setOccupiedSwitchesMessage,
 			&soap::setReversedSwitchesMessage,
-			&soap::setSignalsMessage,
 			&soap::setUnlockedSwitchesMessage,
+			&soap::setSignalsMessage,
+			// Indices 8+ are ignored.
+			&soap::dtmfMessage,
+			&soap::radioTextMessage,
+			&soap::setInterlockErrorSwitchesMessage,
 		};
 		void *body = nullptr;
 		unsigned long index;
 		co_await adapter.checkChannelOperation(WsReceiveMessage(channel.get(), message.get(), const_cast<const WS_MESSAGE_DESCRIPTION **>(descriptionPointers.data()), descriptionPointers.size(), WS_RECEIVE_REQUIRED_MESSAGE, WS_READ_REQUIRED_POINTER, heap.get(), &body, sizeof(body), &index, adapter, nullptr), channel.get());
+		lastMessageTimestamps_ = {.received = latency::Clock::now()};
+		++batchSize;
+		static_assert(descriptionPointers.size() == throughput::actionCounterCount);
+		throughput::add(static_cast<throughput::Counter>(index));
 		if(index == 0) {
 			lastMessage_ = static_cast<soap::SimulationState *>(body);
 			break;
@@ -144,15 +206,52 @@ winrt::Windows::Foundation::IAsyncAction Connection::receiveMessage() {
 			if(permission->permission == soap::DispatcherPermissionLevel::RESCINDED) {
 				throw winrt::hresult_error(error::noDispatcherPermission);
 			}
+		} else if(index <= 7) {
+			// Run 8 resends the full state of each table periodically, so most of these messages change nothing. Count those separately.
+			TrackState::Result result;
+			if(index == 3) {
+				result = trackState.apply(*static_cast<const soap::OccupiedBlocks *>(body));
+			} else if(index == 4) {
+				result = trackState.apply(TrackState::Table::OCCUPIED_SWITCHES, *static_cast<const soap::SwitchList *>(body));
+			} else if(index == 5) {
+				result = trackState.apply(TrackState::Table::REVERSED_SWITCHES, *static_cast<const soap::SwitchList *>(body));
+			} else if(index == 6) {
+				result = trackState.apply(TrackState::Table::UNLOCKED_SWITCHES, *static_cast<const soap::SwitchList *>(body));
+			} else {
+				result = trackState.apply(*static_cast<const soap::Signals *>(body));
+			}
+			if(result == TrackState::Result::MALFORMED) {
+				throughput::add(throughput::Counter::MALFORMED_TRACK_STATE_MESSAGES);
+			} else if(result == TrackState::Result::UNCHANGED) {
+				throughput::add(throughput::Counter::UNCHANGED_TRACK_STATE_MESSAGES);
+			}
 		}
 	}
+	lastMessageTimestamps_.decoded = latency::Clock::now();
+}
+
+// Ends the current batch of messages and starts the next.
+//
+// Every message received in the batch is discarded at once by resetting the heap it was decoded into, which saves resetting the heap for each message. The heap keeps its memory when it is reset, so the next batch reuses it. Nothing received before this call may be used after it.
+//
+// receiveMessage also calls this itself once a batch reaches batchLimit messages.
+void Connection::endBatch() {
+	winrt::check_hresult(WsResetHeap(heap.get(), nullptr));
+	batchSize = 0;
 }
 
 // Returns the last message received by receiveMessage.
 //
 // If no message has been received yet, an empty optional is returned.
 //
-// The returned pointer is valid until the next call to receiveMessage.
+// The returned pointer is valid until the next call to receiveMessage, endBatch or reconnect.
 std::optional<Connection::Message> Connection::lastMessage() const {
 	return lastMessage_;
+}
+
+// Returns when the last message received by receiveMessage was received from the socket and decoded.
+//
+// Only the received and decoded timestamps are filled in; the caller fills in the rest as it handles the message.
+const trainlist8::latency::Timestamps &Connection::lastMessageTimestamps() const {
+	return lastMessageTimestamps_;
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include <memory>
 #include <optional>
 #include <variant>
+#include "latency.h"
+#include "track_state.h"
 #include "util.h"
 
 namespace trainlist8 {
@@ -21,13 +23,23 @@ class Connection final {
 
 	explicit Connection();
 	winrt::Windows::Foundation::IAsyncAction connect(winrt::hstring hostname);
+	winrt::Windows::Foundation::IAsyncAction reconnect();
+	const winrt::hstring &hostname() const;
 	winrt::Windows::Foundation::IAsyncAction receiveMessage();
+	void endBatch();
 	std::optional<Message> lastMessage() const;
+	const latency::Timestamps &lastMessageTimestamps() const;
 
 	private:
-	// The Windows Web Services heap used for memory allocation related to the connection.
+	// The name of the computer Run 8 is running on, as passed to connect.
+	winrt::hstring hostname_;
+
+	// The Windows Web Services heap that messages are decoded into, which is reset once per batch rather than once per message.
 	std::unique_ptr<WS_HEAP, ::trainlist8::util::HeapDeleter> heap;
 
+	// The number of messages decoded into the heap since it was last reset, counting those that receiveMessage discarded as well as those it returned.
+	unsigned int batchSize;
+
 	// The duplex session TCP channel connected to Run 8.
 	std::unique_ptr<WS_CHANNEL, ::trainlist8::util::ChannelDeleter> channel;
 
@@ -39,6 +51,14 @@ class Connection final {
 
 	// The most recently received message.
 	std::optional<Message> lastMessage_;
+
+	// When the most recently received message was received and decoded.
+	latency::Timestamps lastMessageTimestamps_;
+
+	// The state of the blocks, switches, and signals, built up from the track state messages so that those that change nothing can be counted.
+	TrackState trackState;
+
+	winrt::Windows::Foundation::IAsyncAction open();
 };
 }
 
@@ -0,0 +1,245 @@
+#include "pch.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <vector>
+#include "database.h"
+#include "error.h"
+
+using trainlist8::database::Database;
+
+namespace trainlist8::database {
+namespace {
+// The header at the start of the database file.
+struct Header final {
+	// The magic number, which must be equal to magic.
+	char magic[4];
+
+	// The format version, which must be equal to version.
+	uint32_t version;
+
+	// The number of entries in the territory table.
+	uint32_t territoryCount;
+
+	// The number of entries in the block table, which is also the number of entries in the displacement table.
+	uint32_t blockCount;
+
+	// The position of the territory table, in bytes from the start of the file.
+	uint32_t territoriesOffset;
+
+	// The position of the block table, in bytes from the start of the file.
+	uint32_t blocksOffset;
+
+	// The position of the displacement table, in bytes from the start of the file.
+	uint32_t displacementsOffset;
+
+	// The position of the string blob, in bytes from the start of the file.
+	uint32_t stringsOffset;
+
+	// The length of the string blob, in UTF-16 code units.
+	uint32_t stringsLength;
+};
+static_assert(sizeof(Header) == 36);
+static_assert(sizeof(Territory) == 12);
+static_assert(sizeof(Block) == 12);
+
+// The expected magic number.
+constexpr char magic[4] = {'T', 'L', '8', 'L'};
+
+// The expected format version.
+constexpr uint32_t version = 2;
+
+// The currently loaded database.
+//
+// This is only accessed from the UI thread, so replacing it between messages cannot pull a table out from under a lookup.
+std::unique_ptr<const Database> currentDatabase;
+
+// Returns a table of elements within the file, or throws if it does not fit.
+template<typename T>
+std::span<const T> table(const void *base, size_t fileSize, uint32_t offset, uint32_t count) {
+	if(offset % alignof(T) != 0 || offset > fileSize || count > (fileSize - offset) / sizeof(T)) {
+		throw winrt::hresult_error(error::invalidLocationDatabase);
+	}
+	return {reinterpret_cast<const T *>(static_cast<const char *>(base) + offset), count};
+}
+
+// Hashes a block ID with a seed. This must match _hash in generate-locations.py.
+uint32_t hash(uint32_t seed, int32_t block) {
+	uint32_t h = static_cast<uint32_t>(block) ^ (seed * 0x9E3779B9U);
+	h ^= h >> 16;
+	h *= 0x85EBCA6BU;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35U;
+	h ^= h >> 16;
+	return h;
+}
+}
+}
+
+// Opens and maps a database file, and checks that its contents are consistent.
+Database::Database(const std::wstring &path) {
+	// Map the file.
+	winrt::file_handle file(CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+	if(!file) {
+		winrt::throw_last_error();
+	}
+	LARGE_INTEGER fileSize;
+	winrt::check_bool(GetFileSizeEx(file.get(), &fileSize));
+	if(static_cast<unsigned long long>(fileSize.QuadPart) < sizeof(Header) || static_cast<unsigned long long>(fileSize.QuadPart) > UINT32_MAX) {
+		throw winrt::hresult_error(error::invalidLocationDatabase);
+	}
+	size_t size = static_cast<size_t>(fileSize.QuadPart);
+	winrt::handle mapping(CreateFileMappingW(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+	if(!mapping) {
+		winrt::throw_last_error();
+	}
+	view.reset(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0));
+	if(!view) {
+		winrt::throw_last_error();
+	}
+
+	// Check the header and find the tables.
+	const Header &header = *static_cast<const Header *>(view.get());
+	if(std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version) {
+		throw winrt::hresult_error(error::invalidLocationDatabase);
+	}
+	territories_ = table<Territory>(view.get(), size, header.territoriesOffset, header.territoryCount);
+	blocks = table<Block>(view.get(), size, header.blocksOffset, header.blockCount);
+	displacements = table<int32_t>(view.get(), size, header.displacementsOffset, header.blockCount);
+	std::span<const wchar_t> stringsTable = table<wchar_t>(view.get(), size, header.stringsOffset, header.stringsLength);
+	strings = std::wstring_view(stringsTable.data(), stringsTable.size());
+
+	// Check that every name is within the string blob and followed by a NUL, so that name() need not check and its result can be passed to functions that expect a C string.
+	auto nameInBounds = [this](uint32_t offset, uint32_t length) -> bool {
+		return offset < strings.size() && length < strings.size() - offset && strings[offset + length] == L'\0';
+	};
+	for(const Territory &i : territories_) {
+		if(!nameInBounds(i.nameOffset, i.nameLength)) {
+			throw winrt::hresult_error(error::invalidLocationDatabase);
+		}
+	}
+	for(const Block &i : blocks) {
+		if(!nameInBounds(i.nameOffset, i.nameLength)) {
+			throw winrt::hresult_error(error::invalidLocationDatabase);
+		}
+	}
+
+	// Check that the territories are sorted with no duplicates and all have three-digit IDs, and build the direct lookup table.
+	territoriesByID.fill(nullptr);
+	for(size_t i = 0; i != territories_.size(); ++i) {
+		if(territories_[i].id >= territoryIDLimit || (i != 0 && territories_[i - 1].id >= territories_[i].id)) {
+			throw winrt::hresult_error(error::invalidLocationDatabase);
+		}
+		territoriesByID[territories_[i].id] = &territories_[i];
+	}
+
+	// Rank the territories by name, so that ordering trains by territory needs no string comparisons. Territories with the same name keep their order by ID.
+	{
+		std::vector<uint32_t> order(territories_.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::ranges::stable_sort(order, {}, [this](uint32_t i) { return name(territories_[i]); });
+		territoryRanks.fill(0);
+		for(size_t i = 0; i != order.size(); ++i) {
+			territoryRanks[territories_[order[i]].id] = static_cast<uint16_t>(i);
+		}
+	}
+
+	// Check that every direct displacement names a real slot and that every block hashes to its own slot, so that blockByID need only compare one ID.
+	for(int32_t i : displacements) {
+		if(i < 0 && static_cast<size_t>(-(static_cast<int64_t>(i) + 1)) >= blocks.size()) {
+			throw winrt::hresult_error(error::invalidLocationDatabase);
+		}
+	}
+	for(size_t i = 0; i != blocks.size(); ++i) {
+		if(slotOf(blocks[i].id) != i) {
+			throw winrt::hresult_error(error::invalidLocationDatabase);
+		}
+	}
+}
+
+// Returns all the territories, sorted by ID.
+std::span<const trainlist8::database::Territory> Database::territories() const {
+	return territories_;
+}
+
+// Finds a territory by ID, or returns nullptr if it is not in the database.
+const trainlist8::database::Territory *Database::territoryByID(uint32_t id) const {
+	return id < territoriesByID.size() ? territoriesByID[id] : nullptr;
+}
+
+// Finds a block by full block ID, or returns nullptr if it is not in the database.
+const trainlist8::database::Block *Database::blockByID(int32_t id) const {
+	if(blocks.empty()) {
+		return nullptr;
+	}
+	const Block &candidate = blocks[slotOf(id)];
+	if(candidate.id == id) {
+		return &candidate;
+	} else {
+		return nullptr;
+	}
+}
+
+// Returns the position of a territory when all the territories in the database are sorted by name.
+uint32_t Database::territoryRank(const Territory &territory) const {
+	return territoryRanks[territory.id];
+}
+
+// Returns the name of a territory.
+//
+// The view is followed by a NUL in memory, so its data pointer can be used as a C string.
+std::wstring_view Database::name(const Territory &territory) const {
+	return strings.substr(territory.nameOffset, territory.nameLength);
+}
+
+// Returns the location name of a block.
+//
+// The view is followed by a NUL in memory, so its data pointer can be used as a C string.
+std::wstring_view Database::name(const Block &block) const {
+	return strings.substr(block.nameOffset, block.nameLength);
+}
+
+void Database::ViewDeleter::operator()(const void *view) const {
+	UnmapViewOfFile(view);
+}
+
+// Returns the slot that a block ID would occupy, if it is in the table.
+//
+// The block table must not be empty.
+size_t Database::slotOf(int32_t id) const {
+	int32_t displacement = displacements[hash(0, id) % displacements.size()];
+	return displacement < 0 ? static_cast<size_t>(-(static_cast<int64_t>(displacement) + 1)) : hash(static_cast<uint32_t>(displacement), id) % blocks.size();
+}
+
+// Returns the path of the database file that ships alongside the executable.
+std::wstring trainlist8::database::defaultPath() {
+	std::wstring path(MAX_PATH, L'\0');
+	for(;;) {
+		DWORD len = GetModuleFileNameW(nullptr, path.data(), static_cast<DWORD>(path.size()));
+		if(!len) {
+			winrt::throw_last_error();
+		} else if(len < path.size()) {
+			path.resize(len);
+			break;
+		}
+		path.resize(path.size() * 2);
+	}
+	path.erase(path.find_last_of(L'\\') + 1);
+	path += L"locations.bin";
+	return path;
+}
+
+// Loads a database file and makes it current.
+//
+// This must be called on the UI thread. If the file cannot be loaded, an exception is thrown and the previous database remains current.
+void trainlist8::database::load(const std::wstring &path) {
+	std::unique_ptr<const Database> newDatabase = std::make_unique<const Database>(path);
+	currentDatabase = std::move(newDatabase);
+}
+
+// Returns the currently loaded database.
+//
+// This must be called on the UI thread, and the returned reference and any views obtained from it must not be kept beyond the current message.
+const Database &trainlist8::database::current() {
+	return *currentDatabase;
+}
\ No newline at end of file
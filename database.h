@@ -0,0 +1,97 @@
+#pragma once
+
+#if !defined(DATABASE_H)
+#define DATABASE_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace trainlist8 {
+namespace database {
+// Territory IDs are three digits, so they are always less than this.
+constexpr uint32_t territoryIDLimit = 1000;
+
+// A territory record in the database file.
+struct Territory final {
+	// The territory ID, which is the first three digits of the block IDs in the territory.
+	uint32_t id;
+
+	// The position of the territory's name in the string blob, in UTF-16 code units.
+	uint32_t nameOffset;
+
+	// The length of the territory's name, in UTF-16 code units.
+	uint32_t nameLength;
+};
+
+// A block record in the database file.
+struct Block final {
+	// The full block ID, including the territory digits.
+	int32_t id;
+
+	// The position of the block's location name in the string blob, in UTF-16 code units.
+	uint32_t nameOffset;
+
+	// The length of the block's location name, in UTF-16 code units.
+	uint32_t nameLength;
+};
+
+// A location database file, mapped into memory.
+//
+// The file is generated by generate-locations.py. Its tables are used in place, without parsing; opening it only checks that every table and string lies within the file.
+class Database final {
+	public:
+	explicit Database(const std::wstring &path);
+	explicit Database(const Database &) = delete;
+
+	void operator=(const Database &) = delete;
+
+	std::span<const Territory> territories() const;
+	const Territory *territoryByID(uint32_t id) const;
+	const Block *blockByID(int32_t id) const;
+	uint32_t territoryRank(const Territory &territory) const;
+	std::wstring_view name(const Territory &territory) const;
+	std::wstring_view name(const Block &block) const;
+
+	private:
+	// A deleter for mapped views that can be used with unique_ptr.
+	class ViewDeleter final {
+		public:
+		void operator()(const void *view) const;
+	};
+
+	// The mapped view of the file.
+	std::unique_ptr<const void, ViewDeleter> view;
+
+	// The territories, sorted by ID.
+	std::span<const Territory> territories_;
+
+	// The territories indexed directly by ID, with nullptr for IDs that are not in the file.
+	std::array<const Territory *, territoryIDLimit> territoriesByID;
+
+	// The position of each territory when the territories are sorted by name, indexed by ID, with zero for IDs that are not in the file.
+	std::array<uint16_t, territoryIDLimit> territoryRanks;
+
+	// The blocks, in the order of their slots in the perfect hash.
+	std::span<const Block> blocks;
+
+	// The displacement table of the perfect hash, indexed by the seed-zero hash of a block ID.
+	std::span<const int32_t> displacements;
+
+	// The string blob.
+	std::wstring_view strings;
+
+	size_t slotOf(int32_t id) const;
+};
+
+std::wstring defaultPath();
+void load(const std::wstring &path);
+const Database &current();
+}
+}
+
+#endif
\ No newline at end of file
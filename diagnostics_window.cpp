@@ -0,0 +1,168 @@
+#include "pch.h"
+#include <iomanip>
+#include <locale>
+#include <sstream>
+#include <string>
+#include "diagnostics_window.h"
+#include "latency.h"
+#include "resource.h"
+#include "throughput.h"
+#include "util.h"
+
+using trainlist8::DiagnosticsWindow;
+
+namespace trainlist8 {
+namespace {
+// The ID of the timer that refreshes the report.
+constexpr UINT_PTR refreshTimerID = 1;
+
+// How often the report is refreshed, in milliseconds.
+constexpr unsigned int refreshInterval = 1000;
+}
+}
+
+constinit const wchar_t DiagnosticsWindow::windowClass[] = L"diagnostics";
+
+DiagnosticsWindow::DiagnosticsWindow(HWND handle, MessagePump &pump, latency::Recorder &recorder, const throughput::Sampler &sampler) :
+	Window(handle, pump),
+	recorder(recorder),
+	sampler(sampler),
+	font(nullptr),
+	reportFont(nullptr),
+	reportEdit(util::createWindowEx(WS_EX_CLIENTEDGE, WC_EDITW, L"", ES_AUTOHSCROLL | ES_AUTOVSCROLL | ES_LEFT | ES_MULTILINE | ES_READONLY | WS_CHILD | WS_HSCROLL | WS_TABSTOP | WS_VISIBLE | WS_VSCROLL, 0, 0, 0, 0, *this, nullptr, instance(), nullptr)),
+	resetButton(util::createWindowEx(0, WC_BUTTONW, util::loadString(instance(), IDS_DIAGNOSTICS_RESET).c_str(), BS_CENTER | BS_PUSHBUTTON | BS_TEXT | BS_VCENTER | WS_CHILD | WS_TABSTOP | WS_VISIBLE, 0, 0, 0, 0, *this, nullptr, instance(), nullptr)),
+	saveButton(util::createWindowEx(0, WC_BUTTONW, util::loadString(instance(), IDS_DIAGNOSTICS_SAVE).c_str(), BS_CENTER | BS_PUSHBUTTON | BS_TEXT | BS_VCENTER | WS_CHILD | WS_TABSTOP | WS_VISIBLE, 0, 0, 0, 0, *this, nullptr, instance(), nullptr)) {
+	updateIcon();
+	updateLayoutAndFont();
+	updateReport();
+	if(!SetTimer(*this, refreshTimerID, refreshInterval, nullptr)) {
+		winrt::throw_last_error();
+	}
+}
+
+LRESULT DiagnosticsWindow::windowProc(unsigned int message, WPARAM wParam, LPARAM lParam) {
+	switch(message) {
+		case WM_CLOSE:
+			DestroyWindow(*this);
+			return 0;
+
+		case WM_COMMAND:
+		{
+			HWND control = reinterpret_cast<HWND>(lParam);
+			if(control == resetButton) {
+				if(HIWORD(wParam) == BN_CLICKED) {
+					recorder.reset();
+					updateReport();
+					return 0;
+				}
+			} else if(control == saveButton) {
+				if(HIWORD(wParam) == BN_CLICKED) {
+					save();
+					return 0;
+				}
+			}
+		}
+		break;
+
+		case WM_DESTROY:
+			KillTimer(*this, refreshTimerID);
+			return 0;
+
+		case WM_DPICHANGED:
+		{
+			const RECT &rect = *reinterpret_cast<const RECT *>(lParam);
+			SetWindowPos(*this, nullptr, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, SWP_NOACTIVATE | SWP_NOOWNERZORDER | SWP_NOZORDER);
+			updateIcon();
+			updateLayoutAndFont();
+		}
+		return 0;
+
+		case WM_SIZE:
+			updateLayout();
+			return 0;
+
+		case WM_TIMER:
+			if(wParam == refreshTimerID) {
+				updateReport();
+				return 0;
+			}
+			break;
+	}
+	return DefWindowProcW(*this, message, wParam, lParam);
+}
+
+void DiagnosticsWindow::updateLayoutAndFont() {
+	// Set a good font for the buttons, and a fixed-pitch one for the report so its columns line up.
+	std::unique_ptr<HFONT, util::FontDeleter> newFont = util::createMessageBoxFont(12, dpi());
+	for(HWND window : {resetButton, saveButton}) {
+		SendMessage(window, WM_SETFONT, reinterpret_cast<WPARAM>(newFont.get()), TRUE);
+	}
+	font = std::move(newFont);
+	LOGFONTW reportFontSpec{
+		.lfHeight = -MulDiv(10, dpi(), 72),
+		.lfPitchAndFamily = FIXED_PITCH | FF_MODERN,
+		.lfFaceName = L"Consolas",
+	};
+	HFONT newReportFont = CreateFontIndirectW(&reportFontSpec);
+	if(!newReportFont) {
+		winrt::throw_last_error();
+	}
+	SendMessage(reportEdit, WM_SETFONT, reinterpret_cast<WPARAM>(newReportFont), TRUE);
+	reportFont.reset(newReportFont);
+
+	// Lay out the controls.
+	updateLayout();
+}
+
+void DiagnosticsWindow::updateLayout() {
+	int margin = MulDiv(10, dpi(), USER_DEFAULT_SCREEN_DPI);
+	int rowHeight = MulDiv(25, dpi(), USER_DEFAULT_SCREEN_DPI);
+	int buttonWidth = MulDiv(100, dpi(), USER_DEFAULT_SCREEN_DPI);
+	RECT clientRect;
+	winrt::check_bool(GetClientRect(*this, &clientRect));
+	int clientWidth = clientRect.right - clientRect.left;
+	int clientHeight = clientRect.bottom - clientRect.top;
+	int buttonsY = clientHeight - margin - rowHeight;
+	MoveWindow(reportEdit, margin, margin, clientWidth - 2 * margin, buttonsY - 2 * margin, TRUE);
+	MoveWindow(saveButton, clientWidth - margin - buttonWidth, buttonsY, buttonWidth, rowHeight, TRUE);
+	MoveWindow(resetButton, clientWidth - 2 * (margin + buttonWidth), buttonsY, buttonWidth, rowHeight, TRUE);
+}
+
+// Replaces the text in the report control with a fresh report, keeping it scrolled to the same place.
+//
+// The throughput rates are those most recently sampled by the main window, which does so on the same period as this refresh.
+void DiagnosticsWindow::updateReport() {
+	int firstLine = static_cast<int>(SendMessage(reportEdit, EM_GETFIRSTVISIBLELINE, 0, 0));
+	winrt::check_bool(SetWindowTextW(reportEdit, (sampler.report() + L"\r\n" + recorder.report()).c_str()));
+	SendMessage(reportEdit, EM_LINESCROLL, 0, firstLine);
+}
+
+// Writes the histograms to a CSV file in the temporary directory and tells the user where it is.
+void DiagnosticsWindow::save() {
+	// Build the filename from the temporary directory and the current time, so successive saves can be compared.
+	std::wstring path(MAX_PATH + 1, L'\0');
+	DWORD len = GetTempPathW(static_cast<DWORD>(path.size()), path.data());
+	if(!len) {
+		winrt::throw_last_error();
+	}
+	path.resize(len);
+	SYSTEMTIME now;
+	GetLocalTime(&now);
+	{
+		std::wostringstream oss;
+		oss.imbue(std::locale::classic());
+		oss << L"trainlist8-latency-" << std::setfill(L'0') << std::setw(4) << now.wYear << std::setw(2) << now.wMonth << std::setw(2) << now.wDay << L'-' << std::setw(2) << now.wHour << std::setw(2) << now.wMinute << std::setw(2) << now.wSecond << L".csv";
+		path += std::move(oss).str();
+	}
+
+	// Write the file.
+	std::string contents = recorder.csv();
+	winrt::file_handle file(CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+	if(!file) {
+		winrt::throw_last_error();
+	}
+	DWORD written;
+	winrt::check_bool(WriteFile(file.get(), contents.data(), static_cast<DWORD>(contents.size()), &written, nullptr));
+
+	MessageBoxW(*this, util::loadAndFormatString(instance(), IDS_DIAGNOSTICS_SAVED, path.c_str()).c_str(), util::loadString(instance(), IDS_APP_NAME).c_str(), MB_OK | MB_ICONINFORMATION);
+}
\ No newline at end of file
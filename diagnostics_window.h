@@ -0,0 +1,46 @@
+#pragma once
+
+#if !defined(DIAGNOSTICS_WINDOW_H)
+#define DIAGNOSTICS_WINDOW_H
+
+#include <memory>
+#include "util.h"
+#include "window.h"
+
+namespace trainlist8 {
+class MessagePump;
+
+namespace latency {
+class Recorder;
+}
+
+namespace throughput {
+class Sampler;
+}
+
+// A window that shows the latency histograms and throughput counters, and allows the histograms to be reset or saved to a file.
+class DiagnosticsWindow final : public Window {
+	public:
+	static const wchar_t windowClass[];
+
+	explicit DiagnosticsWindow(HWND handle, MessagePump &pump, latency::Recorder &recorder, const throughput::Sampler &sampler);
+
+	protected:
+	LRESULT windowProc(unsigned int message, WPARAM wParam, LPARAM lParam) override;
+
+	private:
+	latency::Recorder &recorder;
+	const throughput::Sampler &sampler;
+	std::unique_ptr<HFONT, util::FontDeleter> font, reportFont;
+	HWND reportEdit;
+	HWND resetButton;
+	HWND saveButton;
+
+	void updateLayoutAndFont();
+	void updateLayout();
+	void updateReport();
+	void save();
+};
+}
+
+#endif
\ No newline at end of file
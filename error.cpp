@@ -9,8 +9,10 @@ constexpr unsigned long customerBit = 1UL << 29;
 
 enum Code {
 	CODE_NO_DISPATCHER_PERMISSION = 1,
+	CODE_INVALID_LOCATION_DATABASE = 2,
 };
 }
 }
 
-const winrt::hresult error::noDispatcherPermission = customerBit | MAKE_HRESULT(SEVERITY_ERROR, 0, CODE_NO_DISPATCHER_PERMISSION);
\ No newline at end of file
+const winrt::hresult error::noDispatcherPermission = customerBit | MAKE_HRESULT(SEVERITY_ERROR, 0, CODE_NO_DISPATCHER_PERMISSION);
+const winrt::hresult error::invalidLocationDatabase = customerBit | MAKE_HRESULT(SEVERITY_ERROR, 0, CODE_INVALID_LOCATION_DATABASE);
\ No newline at end of file
@@ -8,6 +8,7 @@
 namespace trainlist8 {
 namespace error {
 extern const winrt::hresult noDispatcherPermission;
+extern const winrt::hresult invalidLocationDatabase;
 }
 }
 
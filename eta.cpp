@@ -0,0 +1,155 @@
+#include "pch.h"
+#include <algorithm>
+#include <cmath>
+#include "eta.h"
+#include "location.h"
+
+using trainlist8::eta::Engine;
+
+namespace trainlist8::eta {
+namespace {
+// The number of WS_DATETIME ticks in a second.
+constexpr double ticksPerSecond = 10000000.0;
+
+// The number of observations after which a traversal mean stops being a plain mean and becomes an exponential moving average, so that it follows changes in how trains are run.
+constexpr uint32_t traversalWindow = 16;
+
+// The longest traversal that is learned from, in seconds. Anything longer is a train that was parked or abandoned rather than one passing through.
+constexpr double longestTraversal = 3600.0;
+
+// The most blocks ahead of a train that a prediction looks, which bounds the cost of an update and stops a learned loop of blocks from going round forever.
+constexpr unsigned int lookahead = 32;
+
+// Combines two 32-bit values into a map key.
+uint64_t key(int32_t high, uint32_t low) {
+	return (static_cast<uint64_t>(static_cast<uint32_t>(high)) << 32) | low;
+}
+
+// Returns which of three buckets a value falls into, given the two boundaries between them.
+template<typename T>
+unsigned int bucket(T value, T first, T second) {
+	return value < first ? 0 : value < second ? 1 : 2;
+}
+}
+}
+
+// Sorts a train into one of classCount classes of trains that can be expected to move alike, by its length, weight and power.
+unsigned int trainlist8::eta::classify(uint32_t length, uint32_t weight, float horsepowerPerTon) {
+	return bucket<uint32_t>(length, 4000, 8000) * 9 + bucket<uint32_t>(weight, 5000, 10000) * 3 + bucket<float>(horsepowerPerTon, 1.5f, 3.0f);
+}
+
+Engine::Engine() :
+	traversals(),
+	successors() {
+}
+
+// Handles an update message for a train: learns from the block it has just left, if it has moved, and predicts when it will reach its next named location.
+//
+// The time is the current simulation time of the train's server. The new prediction is stored in the tracker.
+void Engine::update(Tracker &tracker, int32_t block, uint64_t time, unsigned int trainClass) {
+	if(block != tracker.block) {
+		if(tracker.block != -1 && block != -1) {
+			// The train moved from one block to another. If it was seen entering the block it just left, the time it spent there is a whole traversal.
+			if(tracker.sawEntry && time > tracker.enteredAt) {
+				double seconds = static_cast<double>(time - tracker.enteredAt) / ticksPerSecond;
+				if(seconds <= longestTraversal) {
+					learnTraversal(tracker.block, trainClass, seconds);
+				}
+			}
+			learnSuccessor(tracker.previousBlock, tracker.block, block);
+		}
+		tracker.sawEntry = tracker.block != -1 && block != -1;
+		tracker.previousBlock = tracker.block;
+		tracker.block = block;
+		tracker.enteredAt = time;
+	}
+	tracker.prediction = predict(tracker, time, trainClass);
+}
+
+// Adds an observed traversal time to the running means for a block, both for the train's class and for all classes together.
+void Engine::learnTraversal(int32_t block, unsigned int trainClass, double seconds) {
+	for(unsigned int c : {trainClass, classCount}) {
+		Traversal &t = traversals[key(block, c)];
+		t.count = std::min(t.count + 1, traversalWindow);
+		t.mean += (seconds - t.mean) / t.count;
+	}
+}
+
+// Counts an observation of a train passing from one block to the next.
+//
+// Only two candidates are kept for each pair of blocks, using the Misra–Gries frequent-items scheme: a block that is not a candidate wears both candidates down, and replaces one once its count reaches zero. The most common successor therefore wins out without keeping a count for every block ever seen.
+void Engine::learnSuccessor(int32_t previous, int32_t block, int32_t next) {
+	std::array<Successor, 2> &candidates = successors[key(previous, static_cast<uint32_t>(block))];
+	for(Successor &i : candidates) {
+		if(i.block == next) {
+			++i.count;
+			return;
+		}
+	}
+	for(Successor &i : candidates) {
+		if(!i.count) {
+			i.block = next;
+			i.count = 1;
+			return;
+		}
+	}
+	for(Successor &i : candidates) {
+		--i.count;
+	}
+}
+
+// Returns how long a train of a class is expected to take to pass through a block, in seconds, falling back to all classes together if the class has not been seen there.
+std::optional<double> Engine::expectedTraversal(int32_t block, unsigned int trainClass) const {
+	for(unsigned int c : {trainClass, classCount}) {
+		if(auto i = traversals.find(key(block, c)); i != traversals.end()) {
+			return i->second.mean;
+		}
+	}
+	return {};
+}
+
+// Returns the block that most commonly follows a pair of blocks, or −1 if none has been seen.
+int32_t Engine::expectedSuccessor(int32_t previous, int32_t block) const {
+	if(auto i = successors.find(key(previous, static_cast<uint32_t>(block))); i != successors.end()) {
+		const std::array<Successor, 2> &candidates = i->second;
+		const Successor &best = candidates[0].count >= candidates[1].count ? candidates[0] : candidates[1];
+		if(best.count) {
+			return best.block;
+		}
+	}
+	return -1;
+}
+
+// Follows the most common route ahead of a train, adding up the expected traversal times, until it reaches a block with a known name other than the train's current one.
+//
+// There is no prediction if the route ahead, or the time to cover any part of it, has not been learned yet.
+trainlist8::eta::Prediction Engine::predict(const Tracker &tracker, uint64_t time, unsigned int trainClass) const {
+	if(tracker.block == -1) {
+		return {};
+	}
+	std::optional<double> current = expectedTraversal(tracker.block, trainClass);
+	if(!current) {
+		return {};
+	}
+	double elapsed = time > tracker.enteredAt ? static_cast<double>(time - tracker.enteredAt) / ticksPerSecond : 0.0;
+	double seconds = std::max(*current - elapsed, 0.0);
+	std::optional<std::wstring_view> currentName = location::nameByBlock(tracker.block);
+	int32_t previous = tracker.previousBlock, block = tracker.block;
+	for(unsigned int i = 0; i != lookahead; ++i) {
+		int32_t next = expectedSuccessor(previous, block);
+		if(next == -1) {
+			return {};
+		}
+		if(std::optional<std::wstring_view> name = location::nameByBlock(next); name && name != currentName) {
+			return {.block = next, .seconds = static_cast<uint32_t>(std::lround(seconds))};
+		}
+		std::optional<double> traversal = expectedTraversal(next, trainClass);
+		if(!traversal) {
+			return {};
+		}
+		seconds += *traversal;
+		previous = block;
+		block = next;
+	}
+	return {};
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#if !defined(ETA_H)
+#define ETA_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+namespace trainlist8 {
+namespace eta {
+// The number of classes that trains are sorted into by classify.
+constexpr unsigned int classCount = 27;
+
+unsigned int classify(uint32_t length, uint32_t weight, float horsepowerPerTon);
+
+// A prediction of when a train will reach its next named location.
+struct Prediction final {
+	// A block in the next named location ahead of the train, or −1 if there is no prediction.
+	int32_t block = -1;
+
+	// How long the train is expected to take to get there, in seconds.
+	uint32_t seconds = 0;
+
+	bool operator==(const Prediction &) const = default;
+};
+
+// What the engine knows about one train's progress.
+struct Tracker final {
+	// The block the train occupied before its current one, or −1 if it is not known.
+	int32_t previousBlock = -1;
+
+	// The block the train currently occupies, or −1 if it is not in a signalled location.
+	int32_t block = -1;
+
+	// The simulation time at which the train entered its current block, in the 100-nanosecond ticks of a WS_DATETIME.
+	uint64_t enteredAt = 0;
+
+	// Whether the train was seen entering its current block, and so whether the time it spends there is a whole traversal that can be learned from.
+	bool sawEntry = false;
+
+	// The most recent prediction.
+	Prediction prediction;
+};
+
+// Learns how long trains take to pass through each block, and which block tends to follow which, and uses that to predict when trains will reach their next named locations.
+//
+// Everything is learned from watching trains move; nothing is known in advance. Each update costs a handful of hash lookups plus a walk along the predicted route that is bounded in length, so the engine keeps up with every train at the full message rate.
+class Engine final {
+	public:
+	explicit Engine();
+	explicit Engine(const Engine &) = delete;
+
+	void operator=(const Engine &) = delete;
+
+	void update(Tracker &tracker, int32_t block, uint64_t time, unsigned int trainClass);
+
+	private:
+	// The learned traversal time of a block by one class of train, or by all classes together.
+	struct Traversal final {
+		// The running mean, in seconds.
+		double mean = 0;
+
+		// How many traversals have been observed, up to a limit after which the mean becomes a moving average.
+		uint32_t count = 0;
+	};
+
+	// A block that has been seen to follow another, with a count used to pick the most common one.
+	struct Successor final {
+		// The following block, or −1 for an empty candidate.
+		int32_t block = -1;
+
+		// The frequency estimate.
+		uint32_t count = 0;
+	};
+
+	// The learned traversal times, keyed by block and class, with classCount standing for all classes together.
+	std::unordered_map<uint64_t, Traversal> traversals;
+
+	// The blocks seen to follow each pair of consecutive blocks, keyed by the pair, so that a train's direction of travel is taken into account.
+	std::unordered_map<uint64_t, std::array<Successor, 2>> successors;
+
+	void learnTraversal(int32_t block, unsigned int trainClass, double seconds);
+	void learnSuccessor(int32_t previous, int32_t block, int32_t next);
+	std::optional<double> expectedTraversal(int32_t block, unsigned int trainClass) const;
+	int32_t expectedSuccessor(int32_t previous, int32_t block) const;
+	Prediction predict(const Tracker &tracker, uint64_t time, unsigned int trainClass) const;
+};
+}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,560 @@
+#!/usr/bin/env python3
+
+"""
+Run a stand-in for Run 8's external dispatcher server, for testing without the simulator.
+
+The server listens on the same port as Run 8 and speaks the same protocol: .NET message framing
+over TCP, carrying SOAP 1.2 envelopes in the binary session encoding. When a client connects and
+sends DispatcherConnected, it is granted permission and then receives a SendSimulationState tick
+every second, followed by an UpdateTrainData message for each simulated train. Trains move through
+the blocks named in the "location-csvs" subdirectory.
+
+The server doubles as a load generator for finding the limits of the client. The number of trains,
+the tick interval, the fraction of trains that send an update each tick, how often trains change
+blocks, and a mix of messages that the client is expected to discard (updates that repeat the
+train's previous one unchanged, and DTMF and SetInterlockErrorSwitches messages) can all be set on
+the command line; for example, --trains 10000 --repeat-fraction 0.5 --discarded 200 --report 5.
+With --report, the rates at which messages and bytes are sent, how much data is queued for clients
+that have not read it yet, and how many ticks started late are printed periodically. A client that
+keeps up has little queued and no late ticks.
+
+The Train field names are sent through the session's binary XML dictionary: the first message of
+each session adds them to the dictionary, and every UpdateTrainData after that refers to them by ID.
+Successive sessions add them in opposite orders, so each name has a different ID from one session to
+the next. A client that carried IDs resolved in one session over to the next, for example after
+"drop" makes it reconnect, would therefore misread its trains.
+
+While running, the following commands can be typed on standard input:
+
+drop      Abruptly close all client connections, as if the network failed or Run 8 crashed.
+rescind   Send a PermissionUpdate that rescinds dispatcher permission to all clients.
+quit      Stop the server.
+"""
+
+import argparse
+import asyncio
+import csv
+import datetime
+import math
+import pathlib
+import random
+import re
+import sys
+import threading
+
+
+_TERRITORIES = {
+	"Mojave Sub": 100,
+}
+
+_COMMA_OR_SPACE = re.compile("[, ]")
+
+_PORT = 15192
+
+_SOAP_NS = "http://www.w3.org/2003/05/soap-envelope"
+_ADDRESSING_NS = "http://www.w3.org/2005/08/addressing"
+_TEMPURI_NS = "http://tempuri.org/"
+_MESSAGES_FROM_RUN8_NS = "http://schemas.datacontract.org/2004/07/DispatcherComms.MessagesFromRun8"
+_XSI_NS = "http://www.w3.org/2001/XMLSchema-instance"
+_ARRAYS_NS = "http://schemas.microsoft.com/2003/10/Serialization/Arrays"
+
+# .NET message framing record types.
+_RECORD_VERSION = 0x00
+_RECORD_MODE = 0x01
+_RECORD_VIA = 0x02
+_RECORD_KNOWN_ENCODING = 0x03
+_RECORD_EXTENSIBLE_ENCODING = 0x04
+_RECORD_SIZED_ENVELOPE = 0x06
+_RECORD_END = 0x07
+_RECORD_UPGRADE_REQUEST = 0x09
+_RECORD_PREAMBLE_ACK = 0x0B
+_RECORD_PREAMBLE_END = 0x0C
+
+
+def _multibyte_int31(value):
+	"""Encode an integer in the 7-bits-per-byte format used by framing and binary XML."""
+	ret = bytearray()
+	while True:
+		byte = value & 0x7F
+		value >>= 7
+		if value:
+			ret.append(byte | 0x80)
+		else:
+			ret.append(byte)
+			return bytes(ret)
+
+
+def _string(text):
+	"""Encode a length-prefixed UTF-8 string."""
+	data = text.encode("utf-8")
+	return _multibyte_int31(len(data)) + data
+
+
+def _chars_text(text, end_element):
+	"""Encode a text record holding a string, optionally closing the enclosing element."""
+	data = text.encode("utf-8")
+	if not data:
+		return bytes([0xA9 if end_element else 0xA8])
+	elif len(data) < 0x100:
+		return bytes([0x99 if end_element else 0x98, len(data)]) + data
+	elif len(data) < 0x10000:
+		return bytes([0x9B if end_element else 0x9A]) + len(data).to_bytes(2, "little") + data
+	else:
+		return bytes([0x9D if end_element else 0x9C]) + len(data).to_bytes(4, "little") + data
+
+
+class _Dictionary:
+	"""The strings that a session adds to its binary XML dictionary, and the IDs they are given."""
+
+	def __init__(self, strings):
+		self.strings = tuple(strings)
+		# Strings added by the session take the odd IDs, in the order they are added; the even IDs belong to the static dictionary.
+		self.ids = {string: 2 * i + 1 for i, string in enumerate(self.strings)}
+
+	def string_table(self):
+		"""Encode the string table that adds all the strings, which goes at the start of a message."""
+		data = b"".join(_string(string) for string in self.strings)
+		return _multibyte_int31(len(data)) + data
+
+
+class _Writer:
+	"""Builds a binary XML document, using a session dictionary for the element names and namespaces it holds, if one is given."""
+
+	def __init__(self, dictionary=None):
+		self.data = bytearray()
+		self.dictionary = dictionary
+
+	def _dictionary_id(self, string):
+		"""Return the session dictionary ID of a string, or None if it must be written out in full."""
+		return self.dictionary.ids.get(string) if self.dictionary else None
+
+	def start(self, prefix, name):
+		"""Open an element, with a prefix (a-z) or with the default namespace (empty prefix)."""
+		string_id = self._dictionary_id(name)
+		if string_id is not None:
+			self.data.append(0x44 + ord(prefix) - ord("a") if prefix else 0x42)
+			self.data += _multibyte_int31(string_id)
+		else:
+			self.data.append(0x5E + ord(prefix) - ord("a") if prefix else 0x40)
+			self.data += _string(name)
+
+	def xmlns(self, prefix, uri):
+		"""Declare a namespace on the element just opened."""
+		string_id = self._dictionary_id(uri)
+		if prefix:
+			self.data.append(0x09 if string_id is None else 0x0B)
+			self.data += _string(prefix)
+		else:
+			self.data.append(0x08 if string_id is None else 0x0A)
+		self.data += _string(uri) if string_id is None else _multibyte_int31(string_id)
+
+	def attribute(self, prefix, name, value):
+		"""Add a prefixed attribute to the element just opened."""
+		self.data.append(0x26 + ord(prefix) - ord("a"))
+		self.data += _string(name)
+		self.data += _chars_text(value, False)
+
+	def text_element(self, prefix, name, value):
+		"""Write a complete element containing only text."""
+		self.start(prefix, name)
+		self.data += _chars_text(value, True)
+
+	def end(self):
+		"""Close the innermost open element."""
+		self.data.append(0x01)
+
+
+def _envelope(action, body, dictionary=None, add_strings=False):
+	"""Build a complete sized envelope framing record for a message with the given action and body writer function.
+
+	If a session dictionary is given, the message uses its strings. The message also adds them to the
+	session if add_strings is true, which must be done in the first message of the session.
+	"""
+	w = _Writer(dictionary)
+	w.start("s", "Envelope")
+	w.xmlns("s", _SOAP_NS)
+	w.xmlns("a", _ADDRESSING_NS)
+	w.start("s", "Header")
+	w.start("a", "Action")
+	w.attribute("s", "mustUnderstand", "1")
+	w.data += _chars_text(f"http://tempuri.org/IWCFRun8/{action}", True)
+	w.end()
+	w.start("s", "Body")
+	w.start("", action)
+	w.xmlns("", _TEMPURI_NS)
+	w.start("", "pMessage")
+	w.xmlns("b", _MESSAGES_FROM_RUN8_NS)
+	w.xmlns("i", _XSI_NS)
+	body(w)
+	w.end()
+	w.end()
+	w.end()
+	w.end()
+
+	# In the binary session encoding, each message starts with the strings it adds to the session dictionary.
+	string_table = dictionary.string_table() if add_strings else _multibyte_int31(0)
+	payload = string_table + bytes(w.data)
+	return bytes([_RECORD_SIZED_ENVELOPE]) + _multibyte_int31(len(payload)) + payload
+
+
+def _bool(value):
+	return "true" if value else "false"
+
+
+def permission_update(granted, session_dictionary=None):
+	"""Build a PermissionUpdate message, which adds the strings of a session dictionary to the session if one is given."""
+	def body(w):
+		w.text_element("b", "AIPermission", _bool(False))
+		w.text_element("b", "Permission", "Granted" if granted else "Rescinded")
+	return _envelope("PermissionUpdate", body, session_dictionary, session_dictionary is not None)
+
+
+def send_simulation_state(time):
+	"""Build a SendSimulationState message."""
+	def body(w):
+		w.text_element("b", "IsClient", _bool(False))
+		w.text_element("b", "SimulationTime", time.strftime("%Y-%m-%dT%H:%M:%S.%f0Z"))
+	return _envelope("SendSimulationState", body)
+
+
+def _train_field(name):
+	"""Return the element name of a Train field, as the data contract serializer writes the backing field of an automatic property."""
+	return f"_x003C_{name}_x003E_k__BackingField"
+
+
+def update_train_data(train, dictionary):
+	"""Build an UpdateTrainData message for a train, referring to the field names through a session dictionary."""
+	def body(w):
+		w.start("b", "Train")
+		for name, value in (
+			("AxleCount", train.axles),
+			("BlockID", train.block),
+			("EngineerName", train.engineer_name),
+			("EngineerType", train.engineer_type),
+			("HoldingForDispatcher", _bool(False)),
+			("HpPerTon", f"{train.hp_per_ton:g}"),
+			("LocoNumber", train.loco_number),
+			("RailroadInitials", train.railroad),
+			("RelinquishWhenStopped", _bool(False)),
+			("TrainID", train.id),
+			("TrainLengthFeet", train.length),
+			("TrainSpeedLimitMPH", train.speed_limit),
+			("TrainSpeedMph", f"{train.speed:g}"),
+			("TrainSymbol", train.symbol),
+			("TrainWeightTons", train.weight),
+		):
+			w.text_element("b", _train_field(name), str(value))
+		w.end()
+	return _envelope("UpdateTrainData", body, dictionary)
+
+
+# The strings added to each session's dictionary: the namespace of the Train fields, and their names.
+_SESSION_STRINGS = (_MESSAGES_FROM_RUN8_NS,) + tuple(_train_field(name) for name in (
+	"AxleCount", "BlockID", "EngineerName", "EngineerType", "HoldingForDispatcher", "HpPerTon", "LocoNumber", "RailroadInitials",
+	"RelinquishWhenStopped", "TrainID", "TrainLengthFeet", "TrainSpeedLimitMPH", "TrainSpeedMph", "TrainSymbol", "TrainWeightTons",
+))
+
+# The session dictionaries, which sessions take in turn. Each adds the same strings in a different order, so the IDs change from one session to the next.
+_SESSION_DICTIONARIES = (_Dictionary(_SESSION_STRINGS), _Dictionary(reversed(_SESSION_STRINGS)))
+
+
+def dtmf(channel, tone):
+	"""Build a DTMF message."""
+	def body(w):
+		w.text_element("b", "Channel", str(channel))
+		w.text_element("b", "DTMFType", "None")
+		w.text_element("b", "Tone", tone)
+		w.text_element("b", "TowerDescription", "BNSF_Shirley_Tower")
+	return _envelope("DTMF", body)
+
+
+def set_interlock_error_switches(route, switches):
+	"""Build a SetInterlockErrorSwitches message."""
+	def body(w):
+		w.start("b", "InterlockErrorSwitches")
+		w.xmlns("c", _ARRAYS_NS)
+		for switch in switches:
+			w.text_element("c", "int", str(switch))
+		w.end()
+		w.text_element("b", "Route", str(route))
+	return _envelope("SetInterlockErrorSwitches", body)
+
+
+def load_blocks(csv_dir):
+	"""Load the full IDs of all named blocks, in order."""
+	blocks = set()
+	for csv_file in csv_dir.iterdir():
+		with csv_file.open("r", newline="") as fp:
+			for row in csv.DictReader(fp):
+				route_id = _TERRITORIES[row["Route"]]
+				for block_id in (int(part) for part in _COMMA_OR_SPACE.split(row["Block ID"])):
+					block_id_digits = (math.floor(math.log10(block_id)) + 1) if block_id != 0 else 1
+					blocks.add(route_id * 10 ** block_id_digits + block_id)
+	return sorted(blocks)
+
+
+class Train:
+	"""A simulated train."""
+
+	_RAILROADS = ("BNSF", "UP", "AMTK", "SP")
+
+	def __init__(self, rng, train_id, blocks):
+		self.id = train_id
+		self.railroad = rng.choice(self._RAILROADS)
+		self.loco_number = rng.randrange(1, 10000)
+		self.symbol = f"{rng.choice('QSZMHL')}{rng.choice(('BAR', 'LAC', 'RSV', 'BAK', 'NDL'))}{rng.choice(('BAR', 'LAC', 'RSV', 'BAK', 'NDL'))}{rng.randrange(1, 31):02}"
+		self.axles = rng.randrange(8, 400, 4)
+		self.length = self.axles * 15
+		self.weight = self.axles * 30
+		self.hp_per_ton = round(rng.uniform(0.5, 4.0), 1)
+		self.speed_limit = rng.choice((25, 40, 55, 70, 79))
+		self.speed = 0.0
+		self.engineer_type = rng.choice(("AI", "AI", "AI", "Player", "None"))
+		self.engineer_name = f"Player{train_id}" if self.engineer_type == "Player" else ""
+		self.blocks = blocks
+		self.block_index = rng.randrange(len(blocks))
+		self.block = blocks[self.block_index]
+		self._messages = {}
+		self._message_state = None
+
+	def step(self, rng, block_change_probability):
+		"""Advance the train by one tick."""
+		if self.engineer_type == "None":
+			self.speed = 0.0
+			return
+		self.speed = max(0.0, min(float(self.speed_limit), self.speed + rng.uniform(-5.0, 5.0)))
+		if self.speed > 0 and rng.random() < block_change_probability:
+			self.block_index = (self.block_index + 1) % len(self.blocks)
+			self.block = self.blocks[self.block_index]
+
+	def message(self, dictionary):
+		"""Return an UpdateTrainData message for the train using a session dictionary, encoding it again only if the train has changed since the last one."""
+		state = (self.block, self.speed)
+		if state != self._message_state:
+			self._messages.clear()
+			self._message_state = state
+		message = self._messages.get(dictionary)
+		if message is None:
+			message = self._messages[dictionary] = update_train_data(self, dictionary)
+		return message
+
+
+class Server:
+	"""The stand-in server and its simulated world."""
+
+	def __init__(self, args, blocks):
+		self.args = args
+		self.rng = random.Random(args.seed)
+		self.trains = [Train(self.rng, 1000 + i, blocks) for i in range(args.trains)]
+		self.time = datetime.datetime(2017, 9, 14, 14, 0, 0)
+		self.clients = {}
+		self.sessions = 0
+		self.sent_messages = 0
+		self.sent_bytes = 0
+		self.late_ticks = 0
+		self.stopped = asyncio.Event()
+
+	async def handle_client(self, reader, writer):
+		"""Run the protocol for one client connection."""
+		peer = writer.get_extra_info("peername")
+		print(f"Client {peer} connected", file=sys.stderr)
+		try:
+			await self._read_preamble(reader)
+			writer.write(bytes([_RECORD_PREAMBLE_ACK]))
+			await writer.drain()
+
+			# The first envelope from the client is DispatcherConnected. Its contents do not matter.
+			if not await self._read_envelope(reader):
+				return
+			dictionary = _SESSION_DICTIONARIES[self.sessions % len(_SESSION_DICTIONARIES)]
+			self.sessions += 1
+			writer.write(permission_update(True, dictionary))
+			await writer.drain()
+			writer.transport.set_write_buffer_limits(high=self.args.max_backlog * 1024)
+			self.clients[writer] = dictionary
+
+			# Further envelopes are not expected, but consume them until the client ends the session.
+			while await self._read_envelope(reader):
+				pass
+			writer.write(bytes([_RECORD_END]))
+			await writer.drain()
+		except (asyncio.IncompleteReadError, ConnectionError, ValueError) as exp:
+			print(f"Client {peer}: {exp!r}", file=sys.stderr)
+		finally:
+			self.clients.pop(writer, None)
+			writer.close()
+			print(f"Client {peer} disconnected", file=sys.stderr)
+
+	@staticmethod
+	async def _read_multibyte_int31(reader):
+		value = 0
+		shift = 0
+		while True:
+			byte = (await reader.readexactly(1))[0]
+			value |= (byte & 0x7F) << shift
+			shift += 7
+			if not byte & 0x80:
+				return value
+
+	async def _read_preamble(self, reader):
+		while True:
+			record = (await reader.readexactly(1))[0]
+			if record == _RECORD_VERSION:
+				await reader.readexactly(2)
+			elif record in (_RECORD_MODE, _RECORD_KNOWN_ENCODING):
+				await reader.readexactly(1)
+			elif record in (_RECORD_VIA, _RECORD_EXTENSIBLE_ENCODING):
+				await reader.readexactly(await self._read_multibyte_int31(reader))
+			elif record == _RECORD_UPGRADE_REQUEST:
+				raise ValueError("client requested a stream upgrade, which is not supported")
+			elif record == _RECORD_PREAMBLE_END:
+				return
+			else:
+				raise ValueError(f"unexpected preamble record {record:#x}")
+
+	async def _read_envelope(self, reader):
+		"""Read and discard one envelope, returning False if the client ended the session instead."""
+		record = (await reader.readexactly(1))[0]
+		if record == _RECORD_END:
+			return False
+		elif record == _RECORD_SIZED_ENVELOPE:
+			await reader.readexactly(await self._read_multibyte_int31(reader))
+			return True
+		else:
+			raise ValueError(f"unexpected record {record:#x}")
+
+	def _discarded_message(self):
+		"""Build one of the messages that the client is expected to discard, with random contents."""
+		if self.rng.random() < 0.5:
+			return dtmf(self.rng.randrange(1, 100), f"*{self.rng.randrange(10, 100)}")
+		else:
+			return set_interlock_error_switches(_TERRITORIES["Mojave Sub"], sorted(self.rng.sample(range(1, 200), self.rng.randrange(1, 8))))
+
+	def _tick_messages(self):
+		"""Advance the world by one tick and return the messages to send for it, starting with the SendSimulationState.
+
+		Train updates are returned as the trains themselves, as each is encoded for the session dictionaries of the clients it is sent to.
+		"""
+		self.time += datetime.timedelta(seconds=self.args.tick)
+		updates = []
+		for train in self.trains:
+			# A train that is held still sends exactly the same update as last time, if it sends one at all.
+			if self.rng.random() >= self.args.repeat_fraction:
+				train.step(self.rng, self.args.block_change_probability)
+			if self.rng.random() < self.args.update_fraction:
+				updates.append(train)
+		if self.args.discarded:
+			updates += [self._discarded_message() for _ in range(self.args.discarded)]
+			self.rng.shuffle(updates)
+		return [send_simulation_state(self.time)] + updates
+
+	async def _broadcast(self, messages):
+		"""Send messages to every client, then wait for all clients with too much data queued to catch up at once, rather than one after another."""
+		self.sent_messages += len(messages)
+		writers = list(self.clients.items())
+		encoded = {}
+		for writer, dictionary in writers:
+			data = encoded.get(dictionary)
+			if data is None:
+				data = encoded[dictionary] = b"".join(message if isinstance(message, bytes) else message.message(dictionary) for message in messages)
+			writer.write(data)
+			self.sent_bytes += len(data)
+		writers = [writer for writer, _ in writers]
+		results = await asyncio.gather(*(writer.drain() for writer in writers), return_exceptions=True)
+		for writer, result in zip(writers, results):
+			if isinstance(result, ConnectionError):
+				self.clients.pop(writer, None)
+			elif isinstance(result, BaseException):
+				raise result
+
+	async def simulate(self):
+		"""Send a tick and a round of train updates to every client once per tick interval, in evenly spaced slices."""
+		loop = asyncio.get_running_loop()
+		deadline = loop.time()
+		while True:
+			deadline += self.args.tick
+			await asyncio.sleep(deadline - loop.time())
+			if loop.time() - deadline > self.args.tick:
+				# The last tick took more than a whole interval to generate or send. Start again from now rather than sending the missed ticks back to back.
+				self.late_ticks += 1
+				deadline = loop.time()
+			messages = self._tick_messages()
+			slices = self.args.slices
+			for i in range(slices):
+				await asyncio.sleep(deadline + self.args.tick * i / slices - loop.time())
+				await self._broadcast(messages[len(messages) * i // slices:len(messages) * (i + 1) // slices])
+
+	async def report(self):
+		"""Print how fast data is being sent and how much is waiting to be read by clients, once per report interval."""
+		while True:
+			await asyncio.sleep(self.args.report)
+			backlog = sum(writer.transport.get_write_buffer_size() for writer in self.clients)
+			print(f"{self.sent_messages / self.args.report:.0f} messages/s, {self.sent_bytes / self.args.report / 1024:.0f} KiB/s, {backlog / 1024:.0f} KiB queued for {len(self.clients)} client(s), {self.late_ticks} late tick(s)", file=sys.stderr)
+			self.sent_messages = 0
+			self.sent_bytes = 0
+			self.late_ticks = 0
+
+	def command(self, line):
+		"""Execute a command typed on standard input."""
+		line = line.strip()
+		if line == "drop":
+			print(f"Dropping {len(self.clients)} client(s)", file=sys.stderr)
+			for writer in list(self.clients):
+				writer.transport.abort()
+			self.clients.clear()
+		elif line == "rescind":
+			for writer in list(self.clients):
+				writer.write(permission_update(False))
+		elif line == "quit":
+			self.stopped.set()
+		elif line:
+			print(f"Unknown command {line!r}", file=sys.stderr)
+
+
+async def run(args):
+	server = Server(args, load_blocks(pathlib.Path(__file__).parent / "location-csvs"))
+	loop = asyncio.get_running_loop()
+
+	def read_stdin():
+		for line in sys.stdin:
+			loop.call_soon_threadsafe(server.command, line)
+		loop.call_soon_threadsafe(server.stopped.set)
+	threading.Thread(target=read_stdin, daemon=True).start()
+
+	listener = await asyncio.start_server(server.handle_client, args.host, _PORT)
+	print(f"Listening on {args.host}:{_PORT} with {len(server.trains)} trains", file=sys.stderr)
+	async with listener:
+		# Run until the quit command or end of input, or until the simulation fails.
+		simulate_task = asyncio.create_task(server.simulate())
+		stop_task = asyncio.create_task(server.stopped.wait())
+		tasks = [simulate_task, stop_task]
+		if args.report:
+			tasks.append(asyncio.create_task(server.report()))
+		await asyncio.wait([simulate_task, stop_task], return_when=asyncio.FIRST_COMPLETED)
+		for task in tasks:
+			task.cancel()
+		await asyncio.gather(*tasks, return_exceptions=True)
+		if not simulate_task.cancelled():
+			simulate_task.result()
+
+
+def main():
+	"""The application entry point."""
+	parser = argparse.ArgumentParser(description="Run a stand-in for Run 8's external dispatcher server.")
+	parser.add_argument("--host", default="0.0.0.0", help="the address to listen on")
+	parser.add_argument("--trains", type=int, default=20, help="the number of simulated trains")
+	parser.add_argument("--tick", type=float, default=1.0, help="the number of seconds between simulation ticks")
+	parser.add_argument("--block-change-probability", type=float, default=0.1, help="the probability that a moving train advances to the next block on each tick")
+	parser.add_argument("--update-fraction", type=float, default=1.0, help="the probability that a train sends an update on each tick")
+	parser.add_argument("--repeat-fraction", type=float, default=0.0, help="the probability that a train is held still on each tick, so that any update it sends repeats its last one")
+	parser.add_argument("--discarded", type=int, default=0, help="the number of DTMF and SetInterlockErrorSwitches messages mixed in with the updates on each tick")
+	parser.add_argument("--slices", type=int, default=1, help="the number of evenly spaced writes that each tick's messages are split into")
+	parser.add_argument("--max-backlog", type=int, default=65536, help="the number of KiB that may be queued for a client before the server waits for it")
+	parser.add_argument("--report", type=float, default=0, help="the number of seconds between throughput reports, or 0 for none")
+	parser.add_argument("--seed", type=int, default=None, help="the random number generator seed")
+	args = parser.parse_args()
+	asyncio.run(run(args))
+
+
+if __name__ == "__main__":
+	main()
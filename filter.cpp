@@ -0,0 +1,361 @@
+#include "pch.h"
+#include <algorithm>
+#include <cwctype>
+#include <iterator>
+#include <limits>
+#include "filter.h"
+#include "soap.h"
+
+using trainlist8::filter::Program;
+
+namespace trainlist8::filter {
+namespace {
+// The most values a program's evaluation stack can hold, which is the number of bits in the word it is kept in.
+constexpr size_t stackLimit = 64;
+
+// The deepest that parentheses and negations may nest, which keeps the recursive descent parser from exhausting the thread's stack.
+constexpr size_t nestingLimit = 64;
+
+// Returns whether a character separates words.
+bool isSeparator(wchar_t ch) {
+	return std::iswspace(ch) || ch == L'(' || ch == L')';
+}
+
+// Returns whether two strings are equal ignoring case, where the second is known to be lower case.
+bool equalsIgnoringCase(std::wstring_view x, std::wstring_view lower) {
+	return x.size() == lower.size() && std::equal(x.begin(), x.end(), lower.begin(), [](wchar_t a, wchar_t b) { return static_cast<wchar_t>(std::towlower(a)) == b; });
+}
+
+// Parses a decimal integer with an optional leading minus sign, returning whether it was well-formed and in range.
+bool parseInteger(std::wstring_view text, int32_t &value) {
+	bool negative = !text.empty() && text.front() == L'-';
+	if(negative) {
+		text.remove_prefix(1);
+	}
+	if(text.empty()) {
+		return false;
+	}
+	int64_t magnitude = 0;
+	for(wchar_t ch : text) {
+		if(ch < L'0' || ch > L'9') {
+			return false;
+		}
+		magnitude = magnitude * 10 + (ch - L'0');
+		if(magnitude > static_cast<int64_t>(std::numeric_limits<int32_t>::max()) + 1) {
+			return false;
+		}
+	}
+	int64_t result = negative ? -magnitude : magnitude;
+	if(result > std::numeric_limits<int32_t>::max()) {
+		return false;
+	}
+	value = static_cast<int32_t>(result);
+	return true;
+}
+
+// Parses a single integer, or an inclusive range written as low..high where either end may be omitted to leave it open, returning whether it was well-formed.
+bool parseRange(std::wstring_view text, int32_t &low, int32_t &high) {
+	size_t dots = text.find(L"..");
+	if(dots == std::wstring_view::npos) {
+		if(!parseInteger(text, low)) {
+			return false;
+		}
+		high = low;
+		return true;
+	}
+	std::wstring_view lowText = text.substr(0, dots), highText = text.substr(dots + 2);
+	low = std::numeric_limits<int32_t>::min();
+	high = std::numeric_limits<int32_t>::max();
+	return (lowText.empty() || parseInteger(lowText, low)) && (highText.empty() || parseInteger(highText, high)) && low <= high && !(lowText.empty() && highText.empty());
+}
+
+// Returns whether a string starts with an upper-cased prefix, ignoring the case of the string.
+bool startsWithIgnoringCase(std::wstring_view text, std::wstring_view upperPrefix) {
+	return text.size() >= upperPrefix.size() && std::equal(upperPrefix.begin(), upperPrefix.end(), text.begin(), [](wchar_t a, wchar_t b) { return a == static_cast<wchar_t>(std::towupper(b)); });
+}
+}
+}
+
+// A recursive descent parser that turns a filter expression into a postfix program.
+//
+// The grammar is:
+//   or-expression := and-expression ("or" and-expression)*
+//   and-expression := unary ("and"? unary)*
+//   unary := "not" unary | "(" or-expression ")" | term
+//   term := field ":" value | word
+// A bare word matches symbols starting with it.
+class Program::Compiler final {
+	public:
+	explicit Compiler(std::wstring_view source) :
+		source(source),
+		pos(0),
+		program(),
+		depth(0),
+		nesting(0) {
+	}
+
+	std::optional<Program> run(size_t &errorPosition) {
+		skipSpace();
+		if(pos != source.size()) {
+			if(!parseOr()) {
+				errorPosition = pos;
+				return {};
+			}
+			skipSpace();
+			if(pos != source.size()) {
+				errorPosition = pos;
+				return {};
+			}
+		}
+		return std::move(program);
+	}
+
+	private:
+	// The expression being compiled.
+	std::wstring_view source;
+
+	// The position of the next character to examine.
+	size_t pos;
+
+	// The program built so far.
+	Program program;
+
+	// How many values the program built so far would leave on the stack.
+	size_t depth;
+
+	// How many parentheses and negations enclose the current position.
+	size_t nesting;
+
+	// Advances past whitespace.
+	void skipSpace() {
+		while(pos != source.size() && std::iswspace(source[pos])) {
+			++pos;
+		}
+	}
+
+	// Returns the word at the current position, without consuming it.
+	std::wstring_view peekWord() const {
+		size_t end = pos;
+		while(end != source.size() && !isSeparator(source[end])) {
+			++end;
+		}
+		return source.substr(pos, end - pos);
+	}
+
+	// Consumes a keyword if it is next, returning whether it was.
+	bool acceptKeyword(std::wstring_view keyword) {
+		skipSpace();
+		std::wstring_view word = peekWord();
+		if(equalsIgnoringCase(word, keyword)) {
+			pos += word.size();
+			return true;
+		} else {
+			return false;
+		}
+	}
+
+	// Appends an instruction, keeping track of the stack depth, and returns whether the stack limit still holds.
+	bool emit(Opcode opcode, int32_t low = 0, int32_t high = 0) {
+		switch(opcode) {
+			case Opcode::NOT:
+				break;
+
+			case Opcode::AND:
+			case Opcode::OR:
+				--depth;
+				break;
+
+			default:
+				++depth;
+				break;
+		}
+		program.instructions.push_back({.opcode = opcode, .low = low, .high = high});
+		return depth <= stackLimit;
+	}
+
+	// Appends an instruction whose operand is a string, upper-casing it.
+	bool emitString(Opcode opcode, std::wstring_view operand) {
+		int32_t offset = static_cast<int32_t>(program.strings.size());
+		std::transform(operand.begin(), operand.end(), std::back_inserter(program.strings), [](wchar_t ch) { return static_cast<wchar_t>(std::towupper(ch)); });
+		return emit(opcode, offset, static_cast<int32_t>(operand.size()));
+	}
+
+	bool parseOr() {
+		if(!parseAnd()) {
+			return false;
+		}
+		while(acceptKeyword(L"or")) {
+			if(!parseAnd() || !emit(Opcode::OR)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool parseAnd() {
+		if(!parseUnary()) {
+			return false;
+		}
+		for(;;) {
+			skipSpace();
+			if(pos == source.size() || source[pos] == L')' || equalsIgnoringCase(peekWord(), L"or")) {
+				return true;
+			}
+			acceptKeyword(L"and");
+			if(!parseUnary() || !emit(Opcode::AND)) {
+				return false;
+			}
+		}
+	}
+
+	bool parseUnary() {
+		if(acceptKeyword(L"not")) {
+			if(++nesting > nestingLimit || !parseUnary() || !emit(Opcode::NOT)) {
+				return false;
+			}
+			--nesting;
+			return true;
+		}
+		skipSpace();
+		if(pos != source.size() && source[pos] == L'(') {
+			++pos;
+			if(++nesting > nestingLimit || !parseOr()) {
+				return false;
+			}
+			skipSpace();
+			if(pos == source.size() || source[pos] != L')') {
+				return false;
+			}
+			++pos;
+			--nesting;
+			return true;
+		}
+		return parseTerm();
+	}
+
+	bool parseTerm() {
+		std::wstring_view word = peekWord();
+		if(word.empty()) {
+			return false;
+		}
+		size_t colon = word.find(L':');
+		if(colon == std::wstring_view::npos) {
+			pos += word.size();
+			program.fields |= 1U << static_cast<unsigned int>(Field::SYMBOL);
+			return emitString(Opcode::SYMBOL_PREFIX, word);
+		}
+		std::wstring_view field = word.substr(0, colon), value = word.substr(colon + 1);
+		if(value.empty()) {
+			// Point at where the value should have been.
+			pos += colon + 1;
+			return false;
+		}
+		int32_t low, high;
+		if(equalsIgnoringCase(field, L"symbol")) {
+			program.fields |= 1U << static_cast<unsigned int>(Field::SYMBOL);
+			if(!emitString(Opcode::SYMBOL_PREFIX, value)) {
+				return false;
+			}
+		} else if(equalsIgnoringCase(field, L"railroad")) {
+			program.fields |= 1U << static_cast<unsigned int>(Field::RAILROAD);
+			if(!emitString(Opcode::RAILROAD_EQUALS, value)) {
+				return false;
+			}
+		} else if(equalsIgnoringCase(field, L"crew")) {
+			soap::EngineerType type;
+			if(equalsIgnoringCase(value, L"player")) {
+				type = soap::EngineerType::PLAYER;
+			} else if(equalsIgnoringCase(value, L"ai")) {
+				type = soap::EngineerType::AI;
+			} else if(equalsIgnoringCase(value, L"none")) {
+				type = soap::EngineerType::NONE;
+			} else {
+				pos += colon + 1;
+				return false;
+			}
+			program.fields |= 1U << static_cast<unsigned int>(Field::CREW);
+			if(!emit(Opcode::CREW_EQUALS, static_cast<int32_t>(type))) {
+				return false;
+			}
+		} else if(equalsIgnoringCase(field, L"speed") || equalsIgnoringCase(field, L"block")) {
+			if(!parseRange(value, low, high)) {
+				pos += colon + 1;
+				return false;
+			}
+			bool speed = equalsIgnoringCase(field, L"speed");
+			program.fields |= 1U << static_cast<unsigned int>(speed ? Field::SPEED : Field::BLOCK);
+			if(!emit(speed ? Opcode::SPEED_IN_RANGE : Opcode::BLOCK_IN_RANGE, low, high)) {
+				return false;
+			}
+		} else {
+			return false;
+		}
+		pos += word.size();
+		return true;
+	}
+};
+
+// Compiles a filter expression.
+//
+// On success, the program is returned. On failure, an empty optional is returned and errorPosition is set to the index of the character at which the expression stopped making sense. An expression that is empty or only whitespace compiles to a program that matches every train.
+std::optional<Program> Program::compile(std::wstring_view source, size_t &errorPosition) {
+	return Compiler(source).run(errorPosition);
+}
+
+// Constructs a program that matches every train.
+Program::Program() :
+	instructions(),
+	strings(),
+	fields(0) {
+}
+
+// Returns whether the program reads a field, and therefore whether a change to that field could change its result.
+bool Program::uses(Field field) const {
+	return fields & (1U << static_cast<unsigned int>(field));
+}
+
+// Evaluates the program against a train.
+//
+// The stack is kept in the bits of a single word, with the top of the stack in the least significant bit, so evaluation never allocates.
+bool Program::matches(const Subject &subject) const {
+	if(instructions.empty()) {
+		return true;
+	}
+	uint64_t stack = 0;
+	for(const Instruction &i : instructions) {
+		switch(i.opcode) {
+			case Opcode::SYMBOL_PREFIX:
+				stack = (stack << 1) | startsWithIgnoringCase(subject.symbol, std::wstring_view(strings).substr(i.low, i.high));
+				break;
+
+			case Opcode::RAILROAD_EQUALS:
+				stack = (stack << 1) | (subject.railroadInitials.size() == static_cast<size_t>(i.high) && startsWithIgnoringCase(subject.railroadInitials, std::wstring_view(strings).substr(i.low, i.high)));
+				break;
+
+			case Opcode::CREW_EQUALS:
+				stack = (stack << 1) | (static_cast<int32_t>(subject.engineerType) == i.low);
+				break;
+
+			case Opcode::SPEED_IN_RANGE:
+				stack = (stack << 1) | (subject.speed >= i.low && subject.speed <= i.high);
+				break;
+
+			case Opcode::BLOCK_IN_RANGE:
+				stack = (stack << 1) | (subject.block >= i.low && subject.block <= i.high);
+				break;
+
+			case Opcode::NOT:
+				stack ^= 1;
+				break;
+
+			case Opcode::AND:
+				stack = (stack >> 1) & (~uint64_t{1} | (stack & 1));
+				break;
+
+			case Opcode::OR:
+				stack = (stack >> 1) | (stack & 1);
+				break;
+		}
+	}
+	return stack & 1;
+}
\ No newline at end of file
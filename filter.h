@@ -0,0 +1,109 @@
+#pragma once
+
+#if !defined(FILTER_H)
+#define FILTER_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace trainlist8 {
+namespace soap {
+enum class EngineerType : int32_t;
+}
+
+namespace filter {
+// The train fields that a filter can test.
+enum class Field {
+	SYMBOL,
+	RAILROAD,
+	CREW,
+	SPEED,
+	BLOCK,
+};
+
+// The values of a train's fields that a filter is evaluated against.
+struct Subject final {
+	// The train symbol.
+	std::wstring_view symbol;
+
+	// The railroad initials of the lead unit.
+	std::wstring_view railroadInitials;
+
+	// The type of driver.
+	soap::EngineerType engineerType;
+
+	// The train speed, in miles per hour.
+	int speed;
+
+	// The block the train's head end occupies, or −1 if it is not in a signalled location.
+	int32_t block;
+};
+
+// A filter expression compiled into a flat postfix program.
+class Program final {
+	public:
+	static std::optional<Program> compile(std::wstring_view source, size_t &errorPosition);
+
+	explicit Program();
+
+	bool uses(Field field) const;
+	bool matches(const Subject &subject) const;
+
+	private:
+	// The operations a program can perform.
+	enum class Opcode : uint8_t {
+		// Pushes whether the symbol starts with a string.
+		SYMBOL_PREFIX,
+
+		// Pushes whether the railroad initials are equal to a string.
+		RAILROAD_EQUALS,
+
+		// Pushes whether the engineer type is equal to a value.
+		CREW_EQUALS,
+
+		// Pushes whether the speed lies within an inclusive range.
+		SPEED_IN_RANGE,
+
+		// Pushes whether the block lies within an inclusive range.
+		BLOCK_IN_RANGE,
+
+		// Replaces the top of the stack with its negation.
+		NOT,
+
+		// Replaces the top two elements of the stack with their conjunction.
+		AND,
+
+		// Replaces the top two elements of the stack with their disjunction.
+		OR,
+	};
+
+	// A single step of a program.
+	struct Instruction final {
+		// What to do.
+		Opcode opcode;
+
+		// The lower bound of a range, the engineer type, or the position of a string operand in strings.
+		int32_t low;
+
+		// The upper bound of a range, or the length of a string operand.
+		int32_t high;
+	};
+
+	// The instructions, in postfix order. An empty program matches everything.
+	std::vector<Instruction> instructions;
+
+	// The string operands, upper-cased and packed end to end.
+	std::wstring strings;
+
+	// A bit for each Field that the program reads.
+	unsigned int fields;
+
+	class Compiler;
+};
+}
+}
+
+#endif
\ No newline at end of file
@@ -1,16 +1,36 @@
 #!/usr/bin/env python3
 
 """
-Generate the string table resources and lookup table code file for location names.
-
-The input is read from all CSV files in the "location-csvs" subdirectory. The output is written to
-"location.cpp" and "location.rc".
-
-Each input CSV file is expected to have three columns and a header row. The columns should be
-"Route", "Block ID", and "Location". The "Route" should be the name of a route as in the
-_TERRITORIES dictionary. The "Block ID" should be one or more numeric block IDs, excluding the
-leading three digits which indicate territory, separated by commas and/or whitespace. The
-"Location" should be the string to display for those blocks.
+Generate the location database file.
+
+The territories are read from "territories.csv" and the locations from all CSV files in the
+"location-csvs" subdirectory. The output is written to "locations.bin", which the application
+memory-maps at startup and when asked to reload it.
+
+"territories.csv" is expected to have three columns and a header row. The columns should be
+"Territory ID", "Name", and "Route". The "Territory ID" is the three-digit number at the start of
+the territory's block IDs, the "Name" is the string to display for it, and the "Route" is the name
+used for the territory in the location CSV files, which may be empty if there are none.
+
+Each location CSV file is expected to have three columns and a header row. The columns should be
+"Route", "Block ID", and "Location". The "Route" should be the name of a route as in
+"territories.csv". The "Block ID" should be one or more numeric block IDs, excluding the leading
+three digits which indicate territory, separated by commas and/or whitespace. The "Location" should
+be the string to display for those blocks.
+
+The file is little-endian and starts with a header of nine 32-bit fields: the magic number "TL8L",
+the format version, the territory count, the block count, and the offsets of the territory table,
+the block table, the displacement table, and the string blob, followed by the length of the string
+blob in UTF-16 code units. Territory records are (ID, name offset, name length), sorted by ID. Block
+records are (full block ID, name offset, name length), in perfect hash slot order. Name offsets and
+lengths are in UTF-16 code units within the string blob. Each name is stored once, however many records
+refer to it, and is followed by a NUL code unit that is not counted in its length, so the
+application can hand names straight to Windows without copying them.
+
+Block lookup is by a minimal perfect hash built with the hash-and-displace method: every block ID is
+first hashed with seed zero to choose an entry in the displacement table, and the entry either names
+the block's slot directly or gives the seed of a second hash that does. The hash function here must
+match the one in database.cpp exactly.
 """
 
 import argparse
@@ -18,32 +38,125 @@ import csv
 import math
 import pathlib
 import re
+import struct
 
 
-_TERRITORIES = {
-	"Mojave Sub": 100,
-}
-
 _COMMA_OR_SPACE = re.compile("[, ]")
 
-_FIRST_STRING_ID = 10000
+_MAGIC = b"TL8L"
+
+_VERSION = 2
+
+_HEADER = struct.Struct("<4s8I")
+
+_RECORD = struct.Struct("<iII")
+
+_MASK32 = 0xFFFFFFFF
+
+
+def _hash(seed, key):
+	"""Hash a block ID with a seed, identically to the hash function in database.cpp."""
+	h = ((key & _MASK32) ^ ((seed * 0x9E3779B9) & _MASK32)) & _MASK32
+	h ^= h >> 16
+	h = (h * 0x85EBCA6B) & _MASK32
+	h ^= h >> 13
+	h = (h * 0xC2B2AE35) & _MASK32
+	h ^= h >> 16
+	return h
+
+
+def _build_perfect_hash(keys):
+	"""
+	Build a minimal perfect hash over a list of keys.
+
+	Return a tuple of the displacement table and the list of keys in slot order. A non-negative
+	displacement is the seed of the second hash for the keys in that bucket; a negative
+	displacement d means the single key in that bucket is in slot -d - 1.
+	"""
+	size = len(keys)
+	buckets = [[] for _ in range(size)]
+	for key in keys:
+		buckets[_hash(0, key) % size].append(key)
+	displacements = [0] * size
+	slots = [None] * size
+
+	# Place the largest buckets first, while there is the most room, trying seeds until every key
+	# in the bucket lands in a distinct free slot.
+	order = sorted(range(size), key=lambda i: len(buckets[i]), reverse=True)
+	position = 0
+	while position < size and len(buckets[order[position]]) > 1:
+		bucket = buckets[order[position]]
+		seed = 1
+		while True:
+			candidate = [_hash(seed, key) % size for key in bucket]
+			if len(set(candidate)) == len(candidate) and all(slots[i] is None for i in candidate):
+				break
+			seed += 1
+		for key, slot in zip(bucket, candidate):
+			slots[slot] = key
+		displacements[order[position]] = seed
+		position += 1
+
+	# Buckets with one key can go in any free slot, so point at one directly.
+	free = [i for i in range(size) if slots[i] is None]
+	while position < size and len(buckets[order[position]]) == 1:
+		slot = free.pop()
+		slots[slot] = buckets[order[position]][0]
+		displacements[order[position]] = -slot - 1
+		position += 1
+
+	return displacements, slots
+
+
+class _StringBlob:
+	"""A blob of UTF-16 strings, each stored once however many records refer to it."""
+
+	def __init__(self):
+		self._data = bytearray()
+		self._offsets = {}
+
+	def add(self, string):
+		"""Add a string if not already present, returning its offset and length in code units."""
+		encoded = string.encode("utf-16-le")
+		if string not in self._offsets:
+			self._offsets[string] = len(self._data) // 2
+			self._data += encoded + b"\0\0"
+		return self._offsets[string], len(encoded) // 2
+
+	def data(self):
+		"""Return the blob."""
+		return bytes(self._data)
 
 
 def main():
 	"""The application entry point."""
+	parser = argparse.ArgumentParser(description="Generate the location database file.")
+	parser.add_argument("--output", type=pathlib.Path, default=pathlib.Path("locations.bin"), help="the file to write")
+	args = parser.parse_args()
+	territories_file = pathlib.Path("territories.csv")
 	csv_dir = pathlib.Path("location-csvs")
-	cpp_file = pathlib.Path("location.cpp")
-	rc_file = pathlib.Path("location.rc")
+
+	# Load the territories.
+	territories = {}
+	route_ids = {}
+	with territories_file.open("r", newline="", encoding="utf-8") as fp:
+		for row in csv.DictReader(fp):
+			territory_id = int(row["Territory ID"])
+			if territory_id in territories:
+				raise ValueError(f"Territory ID {territory_id} appears more than once")
+			territories[territory_id] = row["Name"]
+			if row["Route"]:
+				route_ids[row["Route"]] = territory_id
 
 	# Load a mapping from full block ID to location string.
 	mapping = {}
-	for csv_file in csv_dir.iterdir():
-		with csv_file.open("r", newline="") as fp:
+	for csv_file in sorted(csv_dir.iterdir()):
+		with csv_file.open("r", newline="", encoding="utf-8") as fp:
 			for row in csv.DictReader(fp):
 				route = row["Route"]
 				block_ids = row["Block ID"]
 				location = row["Location"]
-				route_id = _TERRITORIES[route]
+				route_id = route_ids[route]
 				for block_id in (int(part) for part in _COMMA_OR_SPACE.split(block_ids)):
 					block_id_digits = (math.floor(math.log10(block_id)) + 1) if block_id != 0 else 1
 					full_id = route_id * 10 ** block_id_digits + block_id
@@ -51,78 +164,23 @@ def main():
 						raise ValueError(f"Full block ID {full_id} appears more than once")
 					mapping[full_id] = location
 
-	# Generate the ID numbers of the distinct strings.
-	string_ids = {}
-	strings_by_id = {}
-	next_id = _FIRST_STRING_ID
-	for location in sorted(mapping.values()):
-		if location not in string_ids:
-			string_ids[location] = next_id
-			strings_by_id[next_id] = location
-			next_id += 1
-
-	# Generate the block-ID-to-string-ID mapping table source code.
-	cpp_text = f"""#include "pch.h"
-#include "location.h"
-#include "util.h"
-#include <algorithm>
-#include <array>
-#include <memory>
-#include <utility>
-
-namespace trainlist8::location {{
-namespace {{
-constexpr size_t count = {len(mapping)};
-
-constexpr std::array<std::pair<int32_t, unsigned int>, count> blockIDToLocationStringID{{{{
-"""
-	for block_id, string in sorted(mapping.items()):
-		cpp_text += f"\t{{{block_id}, {string_ids[string]}}},\n"
-	cpp_text += f"""
-}}}};
-
-static_assert(std::is_sorted(blockIDToLocationStringID.cbegin(), blockIDToLocationStringID.cend()));
-
-// The loaded string resources, in the same order as blockIDToLocationStringID.
-constinit std::array<std::unique_ptr<std::wstring>, count> strings;
-}}
-}}
-
-// Loads the location name strings.
-void trainlist8::location::init(HINSTANCE instance) {{
-	for(size_t i = 0; i != blockIDToLocationStringID.size(); ++i) {{
-		strings[i].reset(new std::wstring(util::loadString(instance, blockIDToLocationStringID[i].second)));
-	}}
-}}
-
-// Finds the name of a location, if known, or nullptr if not.
-const std::wstring *trainlist8::location::nameByBlock(int32_t block) {{
-	auto i = std::lower_bound(blockIDToLocationStringID.cbegin(), blockIDToLocationStringID.cend(), block,
-		[](const std::pair<int32_t, unsigned int> &candidate, int32_t target) -> bool {{
-			return candidate.first < target;
-		}});
-	if(i != blockIDToLocationStringID.cend() && i->first == block) {{
-		return strings[i - blockIDToLocationStringID.cbegin()].get();
-	}} else {{
-		return nullptr;
-	}}
-}}
-"""
-
-	# Generate the resource script.
-	rc_text = """#include "winres.h"
-LANGUAGE LANG_ENGLISH, SUBLANG_NEUTRAL
-STRINGTABLE
-BEGIN
-"""
-	for string_id, string in sorted(strings_by_id.items()):
-		string_escaped = string.replace("\"", "\"\"")
-		rc_text += f"\t{string_id} \"{string_escaped}\"\n"
-	rc_text += "END\n"
-
-	# Write the output files.
-	cpp_file.write_text(cpp_text)
-	rc_file.write_text(rc_text)
+	# Generate the perfect hash.
+	displacements, slots = _build_perfect_hash(sorted(mapping))
+
+	# Lay out the tables.
+	blob = _StringBlob()
+	territory_table = b"".join(_RECORD.pack(territory_id, *blob.add(name)) for territory_id, name in sorted(territories.items()))
+	block_table = b"".join(_RECORD.pack(block_id, *blob.add(mapping[block_id])) for block_id in slots)
+	displacement_table = struct.pack(f"<{len(displacements)}i", *displacements)
+	strings = blob.data()
+	territories_offset = _HEADER.size
+	blocks_offset = territories_offset + len(territory_table)
+	displacements_offset = blocks_offset + len(block_table)
+	strings_offset = displacements_offset + len(displacement_table)
+	header = _HEADER.pack(_MAGIC, _VERSION, len(territories), len(slots), territories_offset, blocks_offset, displacements_offset, strings_offset, len(strings) // 2)
+
+	# Write the output file.
+	args.output.write_bytes(header + territory_table + block_table + displacement_table + strings)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,131 @@
+#include "pch.h"
+#include <algorithm>
+#include "history.h"
+
+using trainlist8::history::Pool;
+
+// Constructs a pool whose samples take up at most a given number of bytes.
+Pool::Pool(size_t budget) :
+	budget_(0),
+	slab(),
+	slots(),
+	oldest(none),
+	newest(none),
+	firstFree(none),
+	nextGeneration(1) {
+	reset(budget);
+}
+
+// Returns the maximum number of bytes of samples that the pool may hold.
+size_t Pool::budget() const {
+	return budget_;
+}
+
+// Discards every history and resizes the pool to hold at most a given number of bytes of samples.
+void Pool::reset(size_t budget) {
+	size_t count = budget / bytesPerTrain;
+	budget_ = budget;
+	slab = std::make_unique<Sample[]>(count * samplesPerTrain);
+	slots.assign(count, Slot{.generation = 0, .head = 0, .count = 0, .older = none, .newer = none});
+	for(size_t i = 0; i != count; ++i) {
+		slots[i].newer = i + 1 == count ? none : static_cast<uint32_t>(i + 1);
+	}
+	oldest = newest = none;
+	firstFree = count ? 0 : none;
+}
+
+// Allocates an empty history.
+//
+// If every slot is taken and evict is true, the history that was allocated longest ago is evicted to make room; otherwise a handle that refers to nothing is returned.
+trainlist8::history::Handle Pool::allocate(bool evict) {
+	uint32_t slot;
+	if(firstFree != none) {
+		slot = firstFree;
+		firstFree = slots[slot].newer;
+	} else if(evict && oldest != none) {
+		slot = oldest;
+		unlink(slot);
+	} else {
+		return {};
+	}
+	Slot &s = slots[slot];
+	s.generation = nextGeneration++;
+	if(!nextGeneration) {
+		nextGeneration = 1;
+	}
+	s.head = 0;
+	s.count = 0;
+	s.older = newest;
+	s.newer = none;
+	if(newest != none) {
+		slots[newest].newer = slot;
+	} else {
+		oldest = slot;
+	}
+	newest = slot;
+	return {.slot = slot, .generation = s.generation};
+}
+
+// Frees a history, if the handle still refers to one.
+void Pool::release(Handle handle) {
+	if(contains(handle)) {
+		unlink(handle.slot);
+		slots[handle.slot].generation = 0;
+		slots[handle.slot].newer = firstFree;
+		firstFree = handle.slot;
+	}
+}
+
+// Returns whether a handle still refers to a history.
+bool Pool::contains(Handle handle) const {
+	return handle.generation && handle.slot < slots.size() && slots[handle.slot].generation == handle.generation;
+}
+
+// Adds a sample to a history, overwriting the oldest if it is full.
+//
+// A sample taken at the same simulation time as the newest one replaces it instead, so that several updates within one tick do not crowd out older samples. A stale handle is ignored.
+void Pool::record(Handle handle, const Sample &sample) {
+	if(!contains(handle)) {
+		return;
+	}
+	Slot &s = slots[handle.slot];
+	Sample *ring = slab.get() + static_cast<size_t>(handle.slot) * samplesPerTrain;
+	if(s.count && ring[(s.head + s.count - 1) % samplesPerTrain].time == sample.time) {
+		ring[(s.head + s.count - 1) % samplesPerTrain] = sample;
+	} else if(s.count == samplesPerTrain) {
+		ring[s.head] = sample;
+		s.head = (s.head + 1) % samplesPerTrain;
+	} else {
+		ring[(s.head + s.count) % samplesPerTrain] = sample;
+		++s.count;
+	}
+}
+
+// Returns the samples in a history, oldest first, as two runs that together make up the whole ring.
+//
+// Both runs are empty for a stale handle. The views are invalidated by any other call on the pool.
+std::array<std::span<const trainlist8::history::Sample>, 2> Pool::samples(Handle handle) const {
+	if(!contains(handle)) {
+		return {};
+	}
+	const Slot &s = slots[handle.slot];
+	const Sample *ring = slab.get() + static_cast<size_t>(handle.slot) * samplesPerTrain;
+	size_t first = std::min<size_t>(s.count, samplesPerTrain - s.head);
+	return {std::span<const Sample>(ring + s.head, first), std::span<const Sample>(ring, s.count - first)};
+}
+
+// Removes an allocated slot from the list of allocated slots.
+void Pool::unlink(uint32_t slot) {
+	Slot &s = slots[slot];
+	if(s.older != none) {
+		slots[s.older].newer = s.newer;
+	} else {
+		oldest = s.newer;
+	}
+	if(s.newer != none) {
+		slots[s.newer].older = s.older;
+	} else {
+		newest = s.older;
+	}
+	s.older = s.newer = none;
+}
\ No newline at end of file
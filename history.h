@@ -0,0 +1,107 @@
+#pragma once
+
+#if !defined(HISTORY_H)
+#define HISTORY_H
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace trainlist8 {
+namespace history {
+// A single observation of a train.
+struct Sample final {
+	// The simulation time, in the 100-nanosecond ticks of a WS_DATETIME.
+	uint64_t time;
+
+	// The train speed, in miles per hour.
+	float speed;
+
+	// The block the train's head end occupied, or −1 if it was not in a signalled location.
+	int32_t block;
+};
+
+// How many samples each train's history holds before the oldest are overwritten.
+constexpr size_t samplesPerTrain = 120;
+
+// The number of bytes one train's history occupies in a pool.
+constexpr size_t bytesPerTrain = sizeof(Sample) * samplesPerTrain;
+
+// A reference to one train's history within a Pool.
+//
+// A handle stops referring to anything once its history is released or evicted, or the pool is reset; the pool can tell, so a stale handle is harmless.
+struct Handle final {
+	// The index of the slot holding the history.
+	uint32_t slot = std::numeric_limits<uint32_t>::max();
+
+	// The generation of the slot when the history was allocated, or zero for a handle that never referred to anything.
+	uint32_t generation = 0;
+};
+
+// A fixed-size slab of per-train ring buffers.
+//
+// The whole slab is allocated when the pool is created or reset, so recording a sample never allocates. When every slot is taken, the history that was allocated longest ago is the first to be evicted.
+class Pool final {
+	public:
+	explicit Pool(size_t budget);
+	explicit Pool(const Pool &) = delete;
+
+	void operator=(const Pool &) = delete;
+
+	size_t budget() const;
+	void reset(size_t budget);
+	Handle allocate(bool evict);
+	void release(Handle handle);
+	bool contains(Handle handle) const;
+	void record(Handle handle, const Sample &sample);
+	std::array<std::span<const Sample>, 2> samples(Handle handle) const;
+
+	private:
+	// A marker for the end of a linked list of slots.
+	static constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+	// The bookkeeping for one train's ring buffer.
+	struct Slot final {
+		// The generation of the history in the slot, or zero if the slot is free.
+		uint32_t generation;
+
+		// The position within the ring of the oldest sample.
+		uint32_t head;
+
+		// The number of samples in the ring.
+		uint32_t count;
+
+		// The slot allocated just before this one, or none if this is the oldest.
+		uint32_t older;
+
+		// The slot allocated just after this one, or none if this is the newest; for a free slot, the next free slot.
+		uint32_t newer;
+	};
+
+	// The maximum number of bytes of samples that the pool may hold.
+	size_t budget_;
+
+	// The samples, samplesPerTrain to a slot.
+	std::unique_ptr<Sample[]> slab;
+
+	// The bookkeeping for each slot.
+	std::vector<Slot> slots;
+
+	// The ends of the list of allocated slots, in order of allocation.
+	uint32_t oldest, newest;
+
+	// The first free slot.
+	uint32_t firstFree;
+
+	// The generation to give to the next history allocated. Generations are never reused, even across resets, so a stale handle can never refer to a later history by accident.
+	uint32_t nextGeneration;
+
+	void unlink(uint32_t slot);
+};
+}
+}
+
+#endif
\ No newline at end of file
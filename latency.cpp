@@ -0,0 +1,226 @@
+#include "pch.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iomanip>
+#include <locale>
+#include <sstream>
+#include "latency.h"
+
+using trainlist8::latency::Histogram;
+using trainlist8::latency::Recorder;
+
+namespace trainlist8 {
+namespace latency {
+namespace {
+// The number of buckets per power of two.
+constexpr uint64_t subBucketCount = uint64_t{1} << Histogram::subBucketBits;
+
+// The names of the message types, for reports.
+constexpr std::array<const char *, messageTypeCount> messageTypeNames{
+	"SimulationState",
+	"TrainData",
+};
+
+// The names of the stages, for reports.
+constexpr std::array<const char *, stageCount> stageNames{
+	"Decode",
+	"Dispatch",
+	"Apply",
+	"Invalidate",
+	"Total",
+};
+
+// Converts a duration to microseconds, for reports.
+double toMicroseconds(std::chrono::nanoseconds value) {
+	return std::chrono::duration<double, std::micro>(value).count();
+}
+}
+}
+}
+
+Histogram::Histogram() :
+	buckets(),
+	count_(0),
+	sum(0),
+	max_(0) {
+}
+
+// Records a duration. Negative durations are recorded as zero.
+void Histogram::record(std::chrono::nanoseconds value) {
+	uint64_t ns = static_cast<uint64_t>(std::max(value.count(), std::chrono::nanoseconds::rep{0}));
+	buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(ns, std::memory_order_relaxed);
+	uint64_t oldMax = max_.load(std::memory_order_relaxed);
+	while(ns > oldMax && !max_.compare_exchange_weak(oldMax, ns, std::memory_order_relaxed));
+}
+
+// Discards all recorded durations.
+//
+// Durations recorded concurrently with a reset may be partly kept; the histogram is only used for diagnostics, so this does not matter.
+void Histogram::reset() {
+	for(std::atomic<uint32_t> &i : buckets) {
+		i.store(0, std::memory_order_relaxed);
+	}
+	count_.store(0, std::memory_order_relaxed);
+	sum.store(0, std::memory_order_relaxed);
+	max_.store(0, std::memory_order_relaxed);
+}
+
+// Returns the number of durations recorded.
+uint64_t Histogram::count() const {
+	return count_.load(std::memory_order_relaxed);
+}
+
+// Returns the mean of the durations recorded, or zero if none have been.
+std::chrono::nanoseconds Histogram::mean() const {
+	uint64_t n = count();
+	return std::chrono::nanoseconds(n ? sum.load(std::memory_order_relaxed) / n : 0);
+}
+
+// Returns the longest duration recorded, or zero if none have been.
+std::chrono::nanoseconds Histogram::max() const {
+	return std::chrono::nanoseconds(max_.load(std::memory_order_relaxed));
+}
+
+// Returns the duration below which the given fraction of recorded durations fall, or zero if none have been recorded.
+//
+// The result is the upper bound of the bucket containing the percentile, but never more than the longest duration recorded.
+std::chrono::nanoseconds Histogram::percentile(double fraction) const {
+	uint64_t n = count();
+	if(!n) {
+		return std::chrono::nanoseconds(0);
+	}
+	uint64_t target = std::clamp<uint64_t>(static_cast<uint64_t>(std::ceil(fraction * n)), 1, n);
+	uint64_t seen = 0;
+	for(size_t i = 0; i != bucketCount; ++i) {
+		seen += bucket(i);
+		if(seen >= target) {
+			return std::min(std::chrono::nanoseconds(bucketHigh(i)), max());
+		}
+	}
+	return max();
+}
+
+// Returns the number of durations recorded in a bucket.
+uint64_t Histogram::bucket(size_t index) const {
+	return buckets[index].load(std::memory_order_relaxed);
+}
+
+// Returns the shortest duration, in nanoseconds, that is recorded in a bucket.
+uint64_t Histogram::bucketLow(size_t index) {
+	if(index < subBucketCount) {
+		return index;
+	}
+	unsigned int shift = static_cast<unsigned int>(index >> subBucketBits) - 1;
+	return (subBucketCount + (index & (subBucketCount - 1))) << shift;
+}
+
+// Returns the longest duration, in nanoseconds, that is recorded in a bucket.
+uint64_t Histogram::bucketHigh(size_t index) {
+	if(index < subBucketCount) {
+		return index;
+	}
+	unsigned int shift = static_cast<unsigned int>(index >> subBucketBits) - 1;
+	return bucketLow(index) + (uint64_t{1} << shift) - 1;
+}
+
+// Returns the index of the bucket that holds a duration in nanoseconds.
+size_t Histogram::bucketIndex(uint64_t value) {
+	value = std::min(value, (uint64_t{1} << valueBits) - 1);
+	if(value < subBucketCount) {
+		return static_cast<size_t>(value);
+	}
+	unsigned int shift = static_cast<unsigned int>(std::bit_width(value)) - 1 - subBucketBits;
+	return (static_cast<size_t>(shift + 1) << subBucketBits) + static_cast<size_t>((value >> shift) & (subBucketCount - 1));
+}
+
+// Records the duration of one stage of a message.
+void Recorder::record(MessageType type, Stage stage, std::chrono::nanoseconds duration) {
+	histograms[static_cast<size_t>(type)][static_cast<size_t>(stage)].record(duration);
+}
+
+// Records the durations of every stage that a message reached, plus the total.
+void Recorder::record(MessageType type, const Timestamps &timestamps) {
+	static constexpr std::array<std::pair<Stage, Clock::time_point Timestamps:: *>, stageCount - 1> stageEnds{{
+		{Stage::DECODE, &Timestamps::decoded},
+		{Stage::DISPATCH, &Timestamps::dispatched},
+		{Stage::APPLY, &Timestamps::applied},
+		{Stage::INVALIDATE, &Timestamps::invalidated},
+	}};
+	Clock::time_point previous = timestamps.received;
+	for(const auto &[stage, member] : stageEnds) {
+		Clock::time_point end = timestamps.*member;
+		if(end != Clock::time_point()) {
+			record(type, stage, end - previous);
+			previous = end;
+		}
+	}
+	record(type, Stage::TOTAL, previous - timestamps.received);
+}
+
+// Records how long received data waited for the UI thread to start applying it.
+void Recorder::recordStall(std::chrono::nanoseconds duration) {
+	stalls.record(duration);
+}
+
+// Returns the histogram for one stage of one message type.
+const Histogram &Recorder::histogram(MessageType type, Stage stage) const {
+	return histograms[static_cast<size_t>(type)][static_cast<size_t>(stage)];
+}
+
+// Discards all recorded durations.
+void Recorder::reset() {
+	for(auto &i : histograms) {
+		for(Histogram &j : i) {
+			j.reset();
+		}
+	}
+	stalls.reset();
+}
+
+// Formats a human-readable summary of all the histograms, with durations in microseconds.
+std::wstring Recorder::report() const {
+	std::wostringstream oss;
+	oss.imbue(std::locale::classic());
+	oss << std::fixed << std::setprecision(1);
+	oss << std::left << std::setw(17) << L"Message" << std::setw(12) << L"Stage" << std::right << std::setw(10) << L"Count" << std::setw(10) << L"Mean" << std::setw(10) << L"p50" << std::setw(10) << L"p90" << std::setw(10) << L"p99" << std::setw(10) << L"p99.9" << std::setw(10) << L"Max" << L"\r\n";
+	auto row = [&oss](const char *message, const char *stage, const Histogram &h) {
+		oss << std::left << std::setw(17) << message << std::setw(12) << stage << std::right << std::setw(10) << h.count();
+		for(std::chrono::nanoseconds i : {h.mean(), h.percentile(0.5), h.percentile(0.9), h.percentile(0.99), h.percentile(0.999), h.max()}) {
+			oss << std::setw(10) << toMicroseconds(i);
+		}
+		oss << L"\r\n";
+	};
+	for(size_t type = 0; type != messageTypeCount; ++type) {
+		for(size_t stage = 0; stage != stageCount; ++stage) {
+			row(messageTypeNames[type], stageNames[stage], histograms[type][stage]);
+		}
+	}
+	row("UIThread", "Stall", stalls);
+	return std::move(oss).str();
+}
+
+// Formats the contents of all the histograms as CSV, one row per non-empty bucket, for offline comparison.
+std::string Recorder::csv() const {
+	std::ostringstream oss;
+	oss.imbue(std::locale::classic());
+	oss << "message,stage,low_ns,high_ns,count\r\n";
+	for(size_t type = 0; type != messageTypeCount; ++type) {
+		for(size_t stage = 0; stage != stageCount; ++stage) {
+			const Histogram &h = histograms[type][stage];
+			for(size_t i = 0; i != Histogram::bucketCount; ++i) {
+				if(uint64_t n = h.bucket(i)) {
+					oss << messageTypeNames[type] << ',' << stageNames[stage] << ',' << Histogram::bucketLow(i) << ',' << Histogram::bucketHigh(i) << ',' << n << "\r\n";
+				}
+			}
+		}
+	}
+	for(size_t i = 0; i != Histogram::bucketCount; ++i) {
+		if(uint64_t n = stalls.bucket(i)) {
+			oss << "UIThread,Stall," << Histogram::bucketLow(i) << ',' << Histogram::bucketHigh(i) << ',' << n << "\r\n";
+		}
+	}
+	return std::move(oss).str();
+}
\ No newline at end of file
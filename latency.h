@@ -0,0 +1,135 @@
+#pragma once
+
+#if !defined(LATENCY_H)
+#define LATENCY_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace trainlist8 {
+namespace latency {
+// The clock used to take timestamps.
+using Clock = std::chrono::steady_clock;
+
+// The kinds of message whose latency is measured separately.
+enum class MessageType {
+	SIMULATION_STATE,
+	TRAIN_DATA,
+};
+
+// The number of elements in MessageType.
+constexpr size_t messageTypeCount = static_cast<size_t>(MessageType::TRAIN_DATA) + 1;
+
+// The stages a message passes through, each measured from the end of the previous one.
+enum class Stage {
+	// From WsReceiveMessage completing (which reads the message from the socket and deserializes it) to Connection::receiveMessage returning it.
+	DECODE,
+
+	// From Connection::receiveMessage returning to the message being handled on the UI thread.
+	DISPATCH,
+
+	// From arriving on the UI thread to the train or time data being updated.
+	APPLY,
+
+	// From the data being updated to the affected list view cells and labels being invalidated.
+	INVALIDATE,
+
+	// From WsReceiveMessage completing to the last stage that the message reached.
+	TOTAL,
+};
+
+// The number of elements in Stage.
+constexpr size_t stageCount = static_cast<size_t>(Stage::TOTAL) + 1;
+
+// The times at which a single message finished each stage.
+//
+// A stage that the message never reached, for example because it was filtered out or has no UI, is left at the epoch.
+struct Timestamps final {
+	// When WsReceiveMessage completed.
+	Clock::time_point received;
+
+	// When Connection::receiveMessage returned the message.
+	Clock::time_point decoded;
+
+	// When the message began being handled on the UI thread.
+	Clock::time_point dispatched;
+
+	// When the data in the message was applied.
+	Clock::time_point applied;
+
+	// When the controls displaying the data were invalidated.
+	Clock::time_point invalidated;
+};
+
+// A histogram of durations.
+//
+// Buckets are linear below 16 nanoseconds and logarithmic above, with 16 buckets per power of two, so every recorded value is reported to within about 6%. Recording is lock-free.
+class Histogram final {
+	public:
+	// The base-2 logarithm of the number of buckets per power of two.
+	static constexpr unsigned int subBucketBits = 4;
+
+	// The number of bits in the largest duration, in nanoseconds, that can be recorded; larger values go in the last bucket.
+	static constexpr unsigned int valueBits = 40;
+
+	// The number of buckets.
+	static constexpr size_t bucketCount = static_cast<size_t>(valueBits - subBucketBits + 1) << subBucketBits;
+
+	explicit Histogram();
+	explicit Histogram(const Histogram &) = delete;
+
+	void operator=(const Histogram &) = delete;
+
+	void record(std::chrono::nanoseconds value);
+	void reset();
+	uint64_t count() const;
+	std::chrono::nanoseconds mean() const;
+	std::chrono::nanoseconds max() const;
+	std::chrono::nanoseconds percentile(double fraction) const;
+	uint64_t bucket(size_t index) const;
+	static uint64_t bucketLow(size_t index);
+	static uint64_t bucketHigh(size_t index);
+
+	private:
+	// The number of values recorded in each bucket.
+	std::array<std::atomic<uint32_t>, bucketCount> buckets;
+
+	// The number of values recorded.
+	std::atomic<uint64_t> count_;
+
+	// The sum of the values recorded, in nanoseconds.
+	std::atomic<uint64_t> sum;
+
+	// The largest value recorded, in nanoseconds.
+	std::atomic<uint64_t> max_;
+
+	static size_t bucketIndex(uint64_t value);
+};
+
+// A collection of histograms, one for each stage of each message type.
+class Recorder final {
+	public:
+	explicit Recorder() = default;
+
+	void record(MessageType type, Stage stage, std::chrono::nanoseconds duration);
+	void record(MessageType type, const Timestamps &timestamps);
+	void recordStall(std::chrono::nanoseconds duration);
+	const Histogram &histogram(MessageType type, Stage stage) const;
+	void reset();
+	std::wstring report() const;
+	std::string csv() const;
+
+	private:
+	// The histograms, indexed by message type and then stage.
+	std::array<std::array<Histogram, stageCount>, messageTypeCount> histograms;
+
+	// How long the UI thread took to get round to applying received data each time some was waiting for it.
+	Histogram stalls;
+};
+}
+}
+
+#endif
\ No newline at end of file
@@ -3,12 +3,12 @@
 #if !defined(LOCATION_H)
 #define LOCATION_H
 
-#include <string>
+#include <optional>
+#include <string_view>
 
 namespace trainlist8 {
 namespace location {
-void init(HINSTANCE instance);
-const std::wstring *nameByBlock(int32_t block);
+std::optional<std::wstring_view> nameByBlock(int32_t block);
 }
 }
 
@@ -1,10 +1,11 @@
 #include "pch.h"
 #include <locale>
-#include "location.h"
+#include "database.h"
+#include "error.h"
 #include "main_window.h"
 #include "message_pump.h"
 #include "resource.h"
-#include "territory.h"
+#include "startup.h"
 #include "util.h"
 #include "welcome_window.h"
 
@@ -23,6 +24,7 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE, wchar_t *commandLine, int sho
 		}
 	};
 	WinRTInitializer winRTInitializer;
+	trainlist8::startup::mark("WinRT");
 
 	// Create a dispatcher queue for long running tasks.
 	winrt::Windows::System::DispatcherQueueController dispatcherQueueController = []() {
@@ -37,10 +39,20 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE, wchar_t *commandLine, int sho
 		winrt::check_hresult(CreateDispatcherQueueController(dqcOptions, &raw));
 		return winrt::Windows::System::DispatcherQueueController(raw, winrt::take_ownership_from_abi);
 	}();
+	trainlist8::startup::mark("DispatcherQueue");
 
-	// Load territory and location name strings.
-	trainlist8::territory::init(instance);
-	trainlist8::location::init(instance);
+	// Load the territory and location names. The database is mapped and used in place, so this costs little more than opening the file; it is still done before any window is shown so that a bad file is reported up front rather than partway through a session.
+	{
+		std::wstring path = trainlist8::database::defaultPath();
+		try {
+			trainlist8::database::load(path);
+		} catch(const winrt::hresult_error &exp) {
+			std::wstring message = exp.code() == trainlist8::error::invalidLocationDatabase ? trainlist8::util::loadString(instance, IDS_ERROR_INVALID_LOCATION_DATABASE) : std::wstring(exp.message());
+			MessageBoxW(nullptr, trainlist8::util::loadAndFormatString(instance, IDS_LOCATION_DATABASE_ERROR, message.c_str(), path.c_str()).c_str(), trainlist8::util::loadString(instance, IDS_APP_NAME).c_str(), MB_OK | MB_ICONHAND);
+			return 1;
+		}
+	}
+	trainlist8::startup::mark("LocationDatabase");
 
 	// Initialize common controls.
 	{
@@ -49,8 +61,9 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE, wchar_t *commandLine, int sho
 		icc.dwICC = ICC_STANDARD_CLASSES;
 		winrt::check_bool(InitCommonControlsEx(&icc));
 	}
+	trainlist8::startup::mark("CommonControls");
 
-	// Register window class.
+	// Register window classes. The diagnostics window class is registered when that window is first opened, as most sessions never open it.
 	const auto &welcomeClassRegistration = [instance]() {
 		WNDCLASSEXW windowClass{};
 		windowClass.cbSize = sizeof(windowClass);
@@ -74,6 +87,7 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE, wchar_t *commandLine, int sho
 		return trainlist8::util::WindowClassRegistration(windowClass);
 	}();
 	mainClassRegistration;
+	trainlist8::startup::mark("WindowClasses");
 
 	// Create message pump.
 	trainlist8::MessagePump pump;
@@ -81,7 +95,10 @@ int WINAPI wWinMain(HINSTANCE instance, HINSTANCE, wchar_t *commandLine, int sho
 	// Create welcome window.
 	HWND welcomeHandle = trainlist8::Window::create(WS_EX_WINDOWEDGE, trainlist8::WelcomeWindow::windowClass, trainlist8::util::loadString(instance, IDS_APP_NAME).c_str(), WS_CAPTION | WS_OVERLAPPED | WS_MINIMIZEBOX | WS_SYSMENU, CW_USEDEFAULT, 0, 500, 285, nullptr, nullptr, instance, [&pump, commandLine](HWND handle) { return new trainlist8::WelcomeWindow(handle, pump, commandLine); });
 	winrt::check_bool(ShowWindowAsync(welcomeHandle, showCommand));
+	trainlist8::startup::mark("WelcomeWindow");
 
-	// Run message pump.
-	return pump.run();
+	// Run message pump. If no train was ever shown, write whatever startup timings were recorded on the way out.
+	int ret = pump.run();
+	trainlist8::startup::finish();
+	return ret;
 }
\ No newline at end of file
@@ -2,160 +2,36 @@
 #include <algorithm>
 #include <bitset>
 #include <cassert>
-#include <charconv>
-#include <concepts>
+#include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <cwchar>
 #include <cwctype>
-#include <limits>
+#include <iomanip>
+#include <locale>
+#include <random>
 #include <ranges>
+#include <sstream>
+#include "database.h"
+#include "diagnostics_window.h"
 #include "error.h"
+#include "eta.h"
+#include "filter.h"
+#include "history.h"
 #include "location.h"
 #include "main_window.h"
 #include "resource.h"
 #include "soap.h"
+#include "startup.h"
+#include "territory.h"
+#include "text_format.h"
+#include "trains.h"
 #include "util.h"
 
 using trainlist8::MainWindow;
 
 namespace trainlist8 {
 namespace {
-// Obtains a string element of the current locale.
-std::wstring getLocaleString(LCTYPE attribute) {
-	int len = GetLocaleInfoEx(LOCALE_NAME_USER_DEFAULT, attribute, nullptr, 0);
-	if(!len) {
-		winrt::throw_last_error();
-	}
-	std::wstring buffer(len, L'\0');
-	len = GetLocaleInfoEx(LOCALE_NAME_USER_DEFAULT, attribute, buffer.data(), buffer.size());
-	if(!len) {
-		winrt::throw_last_error();
-	}
-	buffer.resize(len);
-	return buffer;
-}
-
-// Obtains an integer element of the current locale.
-DWORD getLocaleInteger(LCTYPE attribute) {
-	DWORD buffer;
-	int len = GetLocaleInfoEx(LOCALE_NAME_USER_DEFAULT, attribute | LOCALE_RETURN_NUMBER, reinterpret_cast<wchar_t *>(&buffer), sizeof(buffer) / sizeof(wchar_t));
-	if(!len) {
-		winrt::throw_last_error();
-	}
-	assert(len * sizeof(wchar_t) == sizeof(buffer));
-	return buffer;
-}
-
-// Obtains the grouping integer for the current locale.
-unsigned int getLocaleGrouping() {
-	// Algorithm from <https://devblogs.microsoft.com/oldnewthing/20060418-11/?p=31493>.
-	std::wstring str = getLocaleString(LOCALE_SGROUPING);
-	std::erase(str, L';');
-	unsigned int ui = static_cast<unsigned int>(std::stoul(str));
-	if(ui % 10) {
-		ui *= 10;
-	} else {
-		ui /= 10;
-	}
-	return ui;
-}
-
-// Returns a number format suitable for formatting numbers.
-NUMBERFMTW numberFormat(unsigned int decimalPlaces) {
-	static std::wstring decimalSeparator = getLocaleString(LOCALE_SDECIMAL);
-	static std::wstring thousandsSeparator = getLocaleString(LOCALE_STHOUSAND);
-	static NUMBERFMTW base = {
-		.NumDigits = 0,
-		.LeadingZero = getLocaleInteger(LOCALE_ILZERO),
-		.Grouping = getLocaleGrouping(),
-		.lpDecimalSep = const_cast<wchar_t *>(decimalSeparator.c_str()),
-		.lpThousandSep = const_cast<wchar_t *>(thousandsSeparator.c_str()),
-		.NegativeOrder = getLocaleInteger(LOCALE_INEGNUMBER),
-	};
-	NUMBERFMTW ret = base;
-	ret.NumDigits = decimalPlaces;
-	return ret;
-}
-
-// A type that is either integral or floating-point.
-template<typename T>
-concept Numeric = std::integral<T> || std::floating_point<T>;
-
-// Formats a number according to the current locale into a buffer.
-//
-// The result is stored in the wstring field of the buffers parameter.
-template<Numeric T>
-void formatNumber(T value, MainWindow::ScratchBuffers &buffers, unsigned int decimalPlaces) {
-	static constexpr size_t startBufferSize = std::numeric_limits<T>::digits10 + 3;
-
-	// Write the value, in locale-agnostic raw format, to buffers.string.
-	{
-		buffers.string.resize(std::max(startBufferSize, buffers.string.capacity()));
-		for(;;) {
-			std::to_chars_result result;
-			if constexpr(std::integral<T>) {
-				result = std::to_chars(buffers.string.data(), buffers.string.data() + buffers.string.size(), value);
-			} else {
-				// GetNumberFormatEx only likes fixed-point, not scientific notation.
-				result = std::to_chars(buffers.string.data(), buffers.string.data() + buffers.string.size(), value, std::chars_format::fixed);
-			}
-			if(result.ec == std::errc()) {
-				buffers.string.resize(result.ptr - buffers.string.data());
-				break;
-			} else if(result.ec == std::errc::value_too_large) {
-				// to_chars does not tell us how much space it wanted, so just try doubling.
-				buffers.string.resize(buffers.string.size() * 2);
-			} else {
-				throw std::system_error(std::make_error_code(result.ec));
-			}
-		}
-	}
-
-	// Convert the multibyte string in buffers.string to a wide string in buffers.wstring2.
-	for(;;) {
-		// Optimistically try an initial conversion with a buffer.
-		// Once wstring2 settles to a stable allocation, this will succeed nearly all the time, so is faster.
-		// It's slower (three calls instead of two) when the allocation is too small, but that should be rare.
-		buffers.wstring2.resize(std::max(startBufferSize, buffers.wstring2.capacity()));
-		int written = MultiByteToWideChar(CP_ACP, 0, buffers.string.data(), buffers.string.size(), buffers.wstring2.data(), buffers.wstring2.size());
-		if(written) {
-			buffers.wstring2.resize(written);
-			break;
-		}
-		if(GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
-			winrt::throw_last_error();
-		}
-		// Buffer is too small. Make another call without a buffer, which will tell us how big a buffer is needed.
-		int needed = MultiByteToWideChar(CP_ACP, 0, buffers.string.data(), buffers.string.size(), nullptr, 0);
-		if(!needed) {
-			winrt::throw_last_error();
-		}
-		buffers.wstring2.resize(needed);
-	}
-
-	// Add proper number formatting.
-	NUMBERFMTW fmt = numberFormat(decimalPlaces);
-	for(;;) {
-		// Optimistically try an initial conversion with a buffer.
-		// Once wstring2 settles to a stable allocation, this will succeed nearly all the time, so is faster.
-		// It's slower (three calls instead of two) when the allocation is too small, but that should be rare.
-		buffers.wstring.resize(std::max(startBufferSize, buffers.wstring.capacity()));
-		int written = GetNumberFormatEx(LOCALE_NAME_USER_DEFAULT, 0, buffers.wstring2.c_str(), &fmt, buffers.wstring.data(), buffers.wstring.size());
-		if(written) {
-			buffers.wstring.resize(written - 1 /* NUL */);
-			break;
-		}
-		if(GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
-			winrt::throw_last_error();
-		}
-		// Buffer is too small. Make another call without a buffer, which will tell us how big a buffer is needed.
-		int needed = GetNumberFormatEx(LOCALE_NAME_USER_DEFAULT, 0, buffers.wstring2.c_str(), &fmt, nullptr, 0);
-		if(!needed) {
-			winrt::throw_last_error();
-		}
-		buffers.wstring.resize(needed);
-	}
-}
-
 // Metadata about a column of the list.
 class Column {
 	public:
@@ -165,8 +41,10 @@ class Column {
 	// Updates a train object to hold a new value from a SOAP update message, returning whether or not the value changed.
 	virtual bool update(MainWindow::TrainInfo &dest, const soap::TrainData &source) const = 0;
 
-	// Formats the text for this column, given a scratch buffer which may (but need not) be used.
-	virtual const std::wstring &text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &scratch) const = 0;
+	// Formats the text for this column as a NUL-terminated string, given a scratch buffer which may (but need not) be used.
+	//
+	// The returned pointer is valid until the scratch buffer is next used or the location database is reloaded.
+	virtual const wchar_t *text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &scratch) const = 0;
 
 	// Compares two trains based on the value in this column.
 	virtual int compare(const MainWindow::TrainInfo &x, const MainWindow::TrainInfo &y) const = 0;
@@ -180,8 +58,8 @@ class Column {
 // Metadata about a list column that holds a string value.
 class StringColumn : public Column {
 	public:
-	const std::wstring &text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &) const override final {
-		return train.*member;
+	const wchar_t *text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &) const override final {
+		return (train.*member).c_str();
 	}
 
 	int compare(const MainWindow::TrainInfo &x, const MainWindow::TrainInfo &y) const override final {
@@ -206,12 +84,11 @@ class LeadUnitColumn final : public StringColumn {
 	static const LeadUnitColumn instance;
 
 	bool update(MainWindow::TrainInfo &dest, const soap::TrainData &source) const override {
-		std::wostringstream oss;
-		oss.imbue(std::locale::classic());
-		oss << source.railroadInitials << source.locomotiveNumber;
-		std::wstring newValue = std::move(oss).str();
-		if(dest.leadUnit != newValue) {
-			dest.leadUnit = std::move(newValue);
+		// Compare the parts in place, so that the name is only built when the lead unit actually changes.
+		if(dest.locomotiveNumber != source.locomotiveNumber || dest.railroadInitials != source.railroadInitials || dest.leadUnit.empty()) {
+			dest.leadUnit = text_format::leadUnit(source.railroadInitials, source.locomotiveNumber);
+			dest.railroadInitials = source.railroadInitials;
+			dest.locomotiveNumber = source.locomotiveNumber;
 			return true;
 		} else {
 			return false;
@@ -248,7 +125,7 @@ class SymbolColumn final : public StringColumn {
 constexpr const SymbolColumn SymbolColumn::instance;
 
 // Metadata about a list column that holds a numeric value.
-template<Numeric T, typename Source = T>
+template<text_format::Numeric T, typename Source = T>
 class NumberColumn final : public Column {
 	public:
 	explicit constexpr NumberColumn(unsigned int stringID, T MainWindow::TrainInfo:: *member, Source soap::TrainData:: *soapMember, unsigned int decimalPlaces) :
@@ -265,9 +142,9 @@ class NumberColumn final : public Column {
 		return ret;
 	}
 
-	const std::wstring &text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &scratch) const override {
-		formatNumber(train.*member, scratch, decimalPlaces);
-		return scratch.wstring;
+	const wchar_t *text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &scratch) const override {
+		text_format::formatNumber(train.*member, scratch, decimalPlaces);
+		return scratch.wstring.c_str();
 	}
 
 	int compare(const MainWindow::TrainInfo &x, const MainWindow::TrainInfo &y) const override {
@@ -318,28 +195,27 @@ class TerritoryColumn final : public Column {
 		}
 	}
 
-	const std::wstring &text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &scratch) const override {
+	const wchar_t *text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &scratch) const override {
 		if(train.territory) {
-			const std::wstring *n = territory::nameByID(*train.territory);
-			if(n) {
-				// The territory has a known name.
-				return *n;
+			if(std::optional<std::wstring_view> n = territory::nameByID(*train.territory); n) {
+				// The territory has a known name. Names in the database are NUL-terminated, so it can be shown without copying.
+				return n->data();
 			} else {
 				// The territory does not have a known name. Render it as the integer instead.
-				formatNumber(*train.territory, scratch, 0);
-				return scratch.wstring;
+				text_format::formatNumber(*train.territory, scratch, 0);
+				return scratch.wstring.c_str();
 			}
 		} else {
 			// The train is in an unsignalled location.
 			scratch.wstring.clear();
-			return scratch.wstring;
+			return scratch.wstring.c_str();
 		}
 	}
 
 	int compare(const MainWindow::TrainInfo &x, const MainWindow::TrainInfo &y) const override {
 		if(x.territory && y.territory) {
 			// Both are in signalled locations.
-			const std::wstring *xn = territory::nameByID(*x.territory), *yn = territory::nameByID(*y.territory);
+			std::optional<std::wstring_view> xn = territory::nameByID(*x.territory), yn = territory::nameByID(*y.territory);
 			if(xn && yn) {
 				// Both have strings, so order by name.
 				return xn->compare(*yn);
@@ -380,28 +256,33 @@ class LocationColumn final : public Column {
 	bool update(MainWindow::TrainInfo &dest, const soap::TrainData &source) const override {
 		bool changed = source.block != dest.block;
 		dest.block = source.block;
-		if(dest.block != -1 && (location::nameByBlock(dest.block) || !location::nameByBlock(dest.lastNamedBlock))) {			dest.lastNamedBlock = dest.block;
+		if(dest.block != -1 && (location::nameByBlock(dest.block) || !location::nameByBlock(dest.lastNamedBlock))) {
+			dest.lastNamedBlock = dest.block;
 		}
 		return changed;
 	}
 
-	const std::wstring &text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &scratch) const override {
+	const wchar_t *text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &scratch) const override {
 		if(train.lastNamedBlock == train.block) {
 			if(train.block == -1) {
 				// The train is, and always has been, in unsignalled territory.
 				scratch.wstring.clear();
-				return scratch.wstring;
-			} else if(const std::wstring *loc = location::nameByBlock(train.block); loc) {
+				return scratch.wstring.c_str();
+			} else if(std::optional<std::wstring_view> loc = location::nameByBlock(train.block); loc) {
 				// We have a name for the current location.
-				return *loc;
+				return loc->data();
 			} else {
 				// We don't have a name for any location, current or historical. Show the raw block ID.
-				formatNumber(train.block, scratch, 0);
-				return scratch.wstring;
+				text_format::formatNumber(train.block, scratch, 0);
+				return scratch.wstring.c_str();
 			}
-		} else {
+		} else if(std::optional<std::wstring_view> loc = location::nameByBlock(train.lastNamedBlock); loc) {
 			// We don't have a name for where the train is now, but we do have a name for where it used to be. Show that.
-			return *location::nameByBlock(train.lastNamedBlock);
+			return loc->data();
+		} else {
+			// We used to have a name for where the train used to be, but the location database has since been reloaded without it. Show the raw block ID.
+			text_format::formatNumber(train.block, scratch, 0);
+			return scratch.wstring.c_str();
 		}
 	}
 
@@ -417,6 +298,84 @@ class LocationColumn final : public Column {
 };
 constinit const LocationColumn LocationColumn::instance;
 
+// The next location column.
+class NextLocationColumn final : public Column {
+	public:
+	// The only instance of this object.
+	static const NextLocationColumn instance;
+
+	explicit constexpr NextLocationColumn() :
+		Column(IDS_MAIN_COLUMN_NEXT_LOCATION) {
+	}
+
+	bool update(MainWindow::TrainInfo &dest, const soap::TrainData &) const override {
+		// The ETA engine has already made its prediction for this update.
+		int32_t newValue = dest.progress.prediction.block;
+		bool changed = newValue != dest.nextLocation;
+		dest.nextLocation = newValue;
+		return changed;
+	}
+
+	const wchar_t *text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &scratch) const override {
+		if(std::optional<std::wstring_view> loc = location::nameByBlock(train.nextLocation); loc) {
+			return loc->data();
+		} else {
+			// There is no prediction, or the location database has since been reloaded without the predicted location.
+			scratch.wstring.clear();
+			return scratch.wstring.c_str();
+		}
+	}
+
+	int compare(const MainWindow::TrainInfo &x, const MainWindow::TrainInfo &y) const override {
+		return x.nextLocation < y.nextLocation ? -1 : x.nextLocation > y.nextLocation ? 1 : 0;
+	}
+};
+constinit const NextLocationColumn NextLocationColumn::instance;
+
+// The ETA column.
+class EtaColumn final : public Column {
+	public:
+	// The only instance of this object.
+	static const EtaColumn instance;
+
+	explicit constexpr EtaColumn() :
+		Column(IDS_MAIN_COLUMN_ETA) {
+	}
+
+	bool update(MainWindow::TrainInfo &dest, const soap::TrainData &) const override {
+		// The ETA engine has already made its prediction for this update.
+		std::optional<uint32_t> newValue;
+		if(dest.progress.prediction.block != -1) {
+			newValue = dest.progress.prediction.seconds;
+		}
+		bool changed = newValue != dest.etaSeconds;
+		dest.etaSeconds = newValue;
+		return changed;
+	}
+
+	const wchar_t *text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &scratch) const override {
+		scratch.wstring.resize(std::max<size_t>(scratch.wstring.capacity(), 16));
+		int len = train.etaSeconds ? std::swprintf(scratch.wstring.data(), scratch.wstring.size(), L"%u:%02u", *train.etaSeconds / 60, *train.etaSeconds % 60) : 0;
+		scratch.wstring.resize(std::max(len, 0));
+		return scratch.wstring.c_str();
+	}
+
+	int compare(const MainWindow::TrainInfo &x, const MainWindow::TrainInfo &y) const override {
+		if(x.etaSeconds && y.etaSeconds) {
+			return *x.etaSeconds < *y.etaSeconds ? -1 : *x.etaSeconds > *y.etaSeconds ? 1 : 0;
+		} else if(!x.etaSeconds && !y.etaSeconds) {
+			return 0;
+		} else if(x.etaSeconds) {
+			// Y cannot be predicted. It comes after X.
+			return -1;
+		} else {
+			// X cannot be predicted. It comes after Y.
+			return 1;
+		}
+	}
+};
+constinit const EtaColumn EtaColumn::instance;
+
 // The crew column.
 class CrewColumn final : public Column {
 	public:
@@ -434,8 +393,8 @@ class CrewColumn final : public Column {
 		return changed;
 	}
 
-	const std::wstring &text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &) const override {
-		return train.engineerName;
+	const wchar_t *text(const MainWindow::TrainInfo &train, MainWindow::ScratchBuffers &) const override {
+		return train.engineerName.c_str();
 	}
 
 	int compare(const MainWindow::TrainInfo &x, const MainWindow::TrainInfo &y) const override {
@@ -451,15 +410,33 @@ class CrewColumn final : public Column {
 				}
 				return 3;
 			};
-			return mapToSortKey(x.engineerType) < mapToSortKey(y.engineerType);
+			return mapToSortKey(x.engineerType) < mapToSortKey(y.engineerType) ? -1 : 1;
 		} else {
-			return x.engineerName < y.engineerName;
+			return x.engineerName.compare(y.engineerName);
 		}
 	}
 };
 
 constinit const CrewColumn CrewColumn::instance;
 
+// The server column.
+class ServerColumn final : public StringColumn {
+	public:
+	// The only instance of this object.
+	static const ServerColumn instance;
+
+	bool update(MainWindow::TrainInfo &, const soap::TrainData &) const override {
+		// The server is filled in when the train is first seen and never changes afterwards.
+		return false;
+	}
+
+	private:
+	explicit constexpr ServerColumn() :
+		StringColumn(IDS_MAIN_COLUMN_SERVER, &MainWindow::TrainInfo::serverName) {
+	}
+};
+constexpr const ServerColumn ServerColumn::instance;
+
 // The columns.
 static constinit const std::array columnMetadata{
 	static_cast<const Column *>(&LeadUnitColumn::instance),
@@ -470,34 +447,160 @@ static constinit const std::array columnMetadata{
 	static_cast<const Column *>(&speedColumn),
 	static_cast<const Column *>(&TerritoryColumn::instance),
 	static_cast<const Column *>(&LocationColumn::instance),
+	static_cast<const Column *>(&NextLocationColumn::instance),
+	static_cast<const Column *>(&EtaColumn::instance),
 	static_cast<const Column *>(&CrewColumn::instance),
+	static_cast<const Column *>(&ServerColumn::instance),
+};
+static_assert(columnMetadata.size() == MainWindow::columnCount);
+
+// The columns whose values come from the ETA engine rather than from the update message, and which can therefore change even when the message does not.
+constexpr std::array<const Column *, 2> predictedColumns{
+	&NextLocationColumn::instance,
+	&EtaColumn::instance,
+};
+
+// The columns whose text is kept in each train's cells, in the order of the cells. These are the columns whose text must be formatted; every other column's text is held by the train object or the location database already, and is returned from there directly.
+constexpr std::array<const Column *, MainWindow::cellCount> cachedColumns{
+	&lengthColumn,
+	&weightColumn,
+	&horsepowerPerTonColumn,
+	&speedColumn,
+	&EtaColumn::instance,
+};
+
+// The columns whose values make up a train's sort key, in the order they are compared, after the column the list is sorted by.
+constexpr std::array<const Column *, 3> tieBreakColumns{
+	&TerritoryColumn::instance,
+	&LocationColumn::instance,
+	&SymbolColumn::instance,
 };
 
-// The age threshold above which trains are removed.
-constexpr unsigned int ageThreshold = 5;
+// The list view column index of the speed history column, which comes after all the others when it is shown. It has no entry in columnMetadata because it is drawn rather than formatted as text, and the list cannot be sorted by it.
+constexpr int historyColumn = static_cast<int>(columnMetadata.size());
+
+// The history pool sizes offered in the View/History Memory menu, in bytes.
+constexpr std::array<std::pair<unsigned int, size_t>, 4> historyBudgets{{
+	{ID_MAIN_MENU_VIEW_HISTORY_MEMORY_OFF, 0},
+	{ID_MAIN_MENU_VIEW_HISTORY_MEMORY_256K, 256 * 1024},
+	{ID_MAIN_MENU_VIEW_HISTORY_MEMORY_1M, 1024 * 1024},
+	{ID_MAIN_MENU_VIEW_HISTORY_MEMORY_4M, 4 * 1024 * 1024},
+}};
+
+// The history pool size used until the user picks another.
+constexpr size_t defaultHistoryBudget = 1024 * 1024;
+
+// The speed at the top of a speed history cell when the train has not gone any faster, in miles per hour, so that a crawling train does not fill the cell.
+constexpr float minimumHistoryScale = 10.0f;
+
+// The filter field that each column's value feeds, for those columns that feed one.
+constexpr std::array<std::pair<const Column *, filter::Field>, 5> filterFieldColumns{{
+	{&SymbolColumn::instance, filter::Field::SYMBOL},
+	{&LeadUnitColumn::instance, filter::Field::RAILROAD},
+	{&CrewColumn::instance, filter::Field::CREW},
+	{&speedColumn, filter::Field::SPEED},
+	{&LocationColumn::instance, filter::Field::BLOCK},
+}};
+
+// Returns whether an update changed any column that the territory checkboxes or a filter program depend on, and therefore whether the train's visibility must be decided again.
+bool filterInputsChanged(const std::bitset<columnMetadata.size()> &columnsChanged, const filter::Program &program) {
+	for(size_t i = 0; i != columnMetadata.size(); ++i) {
+		if(columnsChanged[i]) {
+			if(columnMetadata[i] == &TerritoryColumn::instance) {
+				return true;
+			}
+			for(const auto &[column, field] : filterFieldColumns) {
+				if(column == columnMetadata[i] && program.uses(field)) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+// Returns whether an update changed any column that a train's sort key is built from.
+bool sortKeyInputsChanged(const std::bitset<columnMetadata.size()> &columnsChanged) {
+	for(size_t i = 0; i != columnMetadata.size(); ++i) {
+		if(columnsChanged[i] && std::ranges::find(tieBreakColumns, columnMetadata[i]) != tieBreakColumns.end()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// The most trains that may have updates waiting for the UI thread at once; see Store::queueUpdate.
+constexpr size_t pendingUpdateLimit = 65536;
+
+// The ID of the timer that refreshes the status label.
+constexpr UINT_PTR statusTimerID = 1;
+
+// How often the status label is refreshed, in milliseconds.
+constexpr unsigned int statusInterval = 1000;
+
+// Formats a rate for the status label.
+std::wstring formatRate(double rate) {
+	std::wostringstream oss;
+	oss.imbue(std::locale::classic());
+	oss << std::fixed << std::setprecision(1) << rate;
+	return std::move(oss).str();
+}
+
+// Builds the key in the trains map for a train, given the index of the server it is on and its ID within that server.
+//
+// Train IDs are only unique within a single Run 8 server, so the server index forms the upper half of the key.
+uint64_t trainKey(size_t server, uint32_t id) {
+	return (static_cast<uint64_t>(server) << 32) | id;
+}
+
+// The delay before the first attempt to reconnect after the connection is lost.
+constexpr std::chrono::milliseconds reconnectBaseDelay(1000);
+
+// The longest delay between attempts to reconnect.
+constexpr std::chrono::milliseconds reconnectMaxDelay(30000);
+
+// Chooses how long to wait before an attempt to reconnect, given how many attempts have already failed.
+//
+// The delay doubles with each failure up to reconnectMaxDelay, and is then chosen at random between half and all of that amount, so that several copies of the application do not all retry in lockstep.
+std::chrono::milliseconds reconnectDelay(unsigned int failures, std::minstd_rand &generator) {
+	std::chrono::milliseconds limit = std::min(reconnectBaseDelay * (1 << std::min(failures, 5u)), reconnectMaxDelay);
+	std::uniform_int_distribution<std::chrono::milliseconds::rep> distribution(limit.count() / 2, limit.count());
+	return std::chrono::milliseconds(distribution(generator));
+}
 }
 }
 
 constinit const wchar_t MainWindow::windowClass[] = L"main";
 
-MainWindow::MainWindow(HWND handle, MessagePump &pump, Connection connection) :
+// Creates the first view of a set of Run 8 servers, and starts receiving messages from them.
+MainWindow::MainWindow(HWND handle, MessagePump &pump, std::vector<Connection> connections) :
+	MainWindow(handle, pump, std::make_shared<Store>(std::move(connections))) {
+	store->start();
+}
+
+// Creates a view of a store that may already hold trains.
+MainWindow::MainWindow(HWND handle, MessagePump &pump, std::shared_ptr<Store> store) :
 	Window(handle, pump),
-	trains(),
+	store(std::move(store)),
+	rows(),
 	driverImageList(nullptr),
 	font(nullptr),
 	timeFrame(util::createWindowEx(0, WC_BUTTONW, util::loadString(instance(), IDS_MAIN_TIME_FRAME).c_str(), BS_GROUPBOX | WS_CHILD | WS_VISIBLE, 0, 0, 0, 0, *this, nullptr, instance(), nullptr)),
 	timeLabel(util::createWindowEx(0, WC_STATICW, L"", WS_CHILD | WS_VISIBLE, 0, 0, 0, 0, timeFrame, nullptr, instance(), nullptr)),
+	statusLabel(util::createWindowEx(0, WC_STATICW, L"", SS_LEFT | SS_NOPREFIX | WS_CHILD | WS_VISIBLE, 0, 0, 0, 0, *this, nullptr, instance(), nullptr)),
+	filterLabel(util::createWindowEx(0, WC_STATICW, util::loadString(instance(), IDS_MAIN_FILTER).c_str(), SS_CENTERIMAGE | SS_LEFT | WS_CHILD | WS_VISIBLE, 0, 0, 0, 0, *this, nullptr, instance(), nullptr)),
+	filterEdit(util::createWindowEx(WS_EX_CLIENTEDGE, WC_EDITW, L"", ES_AUTOHSCROLL | ES_LEFT | WS_CHILD | WS_TABSTOP | WS_VISIBLE, 0, 0, 0, 0, *this, nullptr, instance(), nullptr)),
 	trainsView(util::createWindowEx(WS_EX_CLIENTEDGE, WC_LISTVIEWW, L"", LVS_REPORT | LVS_SHAREIMAGELISTS | WS_CHILD | WS_VISIBLE, 0, 0, 0, 0, *this, nullptr, instance(), nullptr)),
 	getDispInfoBuffers(),
 	sortColumn(0),
 	sortOrder(1),
 	maxTextSize(0),
-	closing(false),
-	connection(std::move(connection)),
-	receiveMessagesAction(receiveMessages()),
-	enabledTerritories([]() {decltype(enabledTerritories) b; b.set(); return b; }()),
+	disabledTerritories(),
 	enabledUnknownTerritories(true),
-	dateTimeFormat(DateTimeFormat::LOCALE) {
+	filterProgram(),
+	historyShown(false),
+	historyPoints(),
+	menusPopulated(false) {
 	// Load the driver image list.
 	driverImageList.reset(ImageList_LoadImageW(instance(), MAKEINTRESOURCE(IDB_DRIVER_ICONS), 24, 0, CLR_DEFAULT, IMAGE_BITMAP, LR_MONOCHROME));
 	if(!driverImageList) {
@@ -516,76 +619,6 @@ MainWindow::MainWindow(HWND handle, MessagePump &pump, Connection connection) :
 		winrt::check_bool(SetMenuInfo(bar, &info));
 	}
 
-	// Populate the View/Territories menu.
-	{
-		// Find the View/Territories menu. It doesn't have an ID because submenus can't have IDs, so we must search for it by knowing that it contains the Unknown item, which does have an ID.
-		HMENU viewMenu = winrt::check_pointer(findSubMenuContainingID(bar, ID_MAIN_MENU_VIEW_TERRITORIES_UNKNOWN));
-		HMENU territoriesMenu = winrt::check_pointer(findSubMenuContainingID(viewMenu, ID_MAIN_MENU_VIEW_TERRITORIES_UNKNOWN));
-
-		// Build the list of strings that will be added to it, which is the territory names but in sorted order, and add them. Give each menu item a dwItemData that is the territory ID. Insert these items before the Unknown item.
-		std::array<std::pair<const std::wstring *, unsigned int>, territory::count> sortedStrings;
-		for(size_t i = 0; i != sortedStrings.size(); ++i) {
-			sortedStrings[i].first = territory::nameByIndex(i);
-			sortedStrings[i].second = territory::idByIndex(i);
-		}
-		std::sort(sortedStrings.begin(), sortedStrings.end(),
-			[](const std::pair<const std::wstring *, unsigned int> &x, const std::pair<const std::wstring *, unsigned int> &y) -> bool {
-				return *x.first < *y.first;
-			});
-		for(size_t i = 0; i != sortedStrings.size(); ++i) {
-			MENUITEMINFOW info{
-				.cbSize = sizeof(info),
-				.fMask = MIIM_DATA | MIIM_FTYPE | MIIM_ID | MIIM_STATE | MIIM_STRING,
-				.fType = MFT_STRING,
-				.fState = MFS_CHECKED,
-				.wID = ID_MAIN_MENU_VIEW_TERRITORIES_SPECIFIC,
-				.dwItemData = sortedStrings[i].second,
-				.dwTypeData = const_cast<wchar_t *>(sortedStrings[i].first->c_str()),
-			};
-			winrt::check_bool(InsertMenuItemW(territoriesMenu, i, TRUE, &info));
-		}
-	}
-
-	// Tick the proper date/time format menu item.
-	updateDateTimeMenuItems();
-
-	// Register for notification of completion of the receive-messages action.
-	auto uiThread = winrt::Windows::System::DispatcherQueue::GetForCurrentThread();
-	receiveMessagesAction.Completed([this, uiThread](const winrt::Windows::Foundation::IAsyncAction &action, winrt::Windows::Foundation::AsyncStatus status) {
-		// Capture the HRESULT, if there was one.
-		winrt::hresult_error error;
-		try {
-			action.GetResults();
-		} catch(const winrt::hresult_error &err) {
-			error = err;
-		}
-
-		// Dispatch on the UI thread to deal with the result.
-		uiThread.TryEnqueue([this, status, error]() {
-			switch(status) {
-				case winrt::Windows::Foundation::AsyncStatus::Completed:
-					// This should never happen; the receiveMessages function never returns normally.
-					std::abort();
-
-				case winrt::Windows::Foundation::AsyncStatus::Canceled:
-					// This is fine. This happens when the user clicks the close button.
-					break;
-
-				case winrt::Windows::Foundation::AsyncStatus::Error:
-					// We should show information about the error before terminating.
-					if(error.code() == error::noDispatcherPermission) {
-						MessageBoxW(*this, util::loadString(instance(), IDS_MAIN_PERMISSION_RESCINDED).c_str(), util::loadString(instance(), IDS_APP_NAME).c_str(), MB_OK | MB_ICONHAND);
-					} else {
-						MessageBoxW(*this, util::loadAndFormatString(instance(), IDS_MAIN_CONNECTION_ERROR, error.message().c_str()).c_str(), util::loadString(instance(), IDS_APP_NAME).c_str(), MB_OK | MB_ICONHAND);
-					}
-					break;
-			}
-
-			// The application should now terminate.
-			DestroyWindow(*this);
-			});
-		});
-
 	// Set up the train list view.
 	{
 		static constexpr DWORD styles = LVS_EX_AUTOSIZECOLUMNS | LVS_EX_FULLROWSELECT | LVS_EX_HEADERDRAGDROP | LVS_EX_LABELTIP;
@@ -604,10 +637,26 @@ MainWindow::MainWindow(HWND handle, MessagePump &pump, Connection connection) :
 		}
 	}
 
+	// Explain the filter syntax in the empty filter box.
+	Edit_SetCueBannerTextFocused(filterEdit, util::loadString(instance(), IDS_MAIN_FILTER_CUE).c_str(), FALSE);
+
 	// Initialize UI layout.
 	updateIcon();
 	updateLayoutAndFont();
 	updateColumnHeaderArrows();
+
+	// List the trains that the store already has.
+	winrt::check_bool(SetWindowTextW(timeLabel, this->store->serverStatusText().c_str()));
+	refilter();
+
+	// Start refreshing the status label.
+	updateStatus();
+	if(!SetTimer(*this, statusTimerID, statusInterval, nullptr)) {
+		winrt::throw_last_error();
+	}
+
+	// Receive updates from the store. This comes last so that the store is never left pointing at a view whose construction failed.
+	this->store->attach(*this);
 }
 
 LRESULT MainWindow::windowProc(unsigned int message, WPARAM wParam, LPARAM lParam) {
@@ -616,8 +665,29 @@ LRESULT MainWindow::windowProc(unsigned int message, WPARAM wParam, LPARAM lPara
 			handleClose();
 			return 0;
 
+		case WM_COMMAND:
+			if(reinterpret_cast<HWND>(lParam) == filterEdit && HIWORD(wParam) == EN_CHANGE) {
+				updateFilter();
+				return 0;
+			}
+			break;
+
 		case WM_DESTROY:
-			PostQuitMessage(0);
+			KillTimer(*this, statusTimerID);
+			store->detach(*this);
+			if(store->views.empty()) {
+				PostQuitMessage(0);
+			}
+			return 0;
+
+		case WM_INITMENU:
+			// The menus are filled in when they are first opened, rather than in the constructor, so that they do not hold up the window being shown.
+			if(!menusPopulated) {
+				populateTerritoriesMenu();
+				updateDateTimeMenuItems();
+				updateHistoryMenuItems();
+				menusPopulated = true;
+			}
 			return 0;
 
 		case WM_DPICHANGED:
@@ -637,8 +707,16 @@ LRESULT MainWindow::windowProc(unsigned int message, WPARAM wParam, LPARAM lPara
 			info.fMask = MIIM_DATA | MIIM_ID | MIIM_STATE;
 			winrt::check_bool(GetMenuItemInfoW(menu, wParam, TRUE, &info));
 			switch(info.wID) {
+				case ID_MAIN_MENU_FILE_RELOAD_LOCATIONS:
+					reloadLocationDatabase();
+					break;
+
 				case ID_MAIN_MENU_FILE_EXIT:
-					handleClose();
+					store->close();
+					break;
+
+				case ID_MAIN_MENU_VIEW_NEW_WINDOW:
+					openView();
 					break;
 
 				case ID_MAIN_MENU_VIEW_ALWAYS_ON_TOP:
@@ -655,8 +733,8 @@ LRESULT MainWindow::windowProc(unsigned int message, WPARAM wParam, LPARAM lPara
 					info.fMask = MIIM_STATE;
 					info.fState ^= MFS_CHECKED;
 					winrt::check_bool(SetMenuItemInfoW(menu, wParam, TRUE, &info));
-					size_t territoryIndex = *territory::indexByID(info.dwItemData);
-					enabledTerritories.set(territoryIndex, info.fState & MFS_CHECKED);
+					disabledTerritories.set(info.dwItemData, !(info.fState & MFS_CHECKED));
+					refilter();
 				}
 				break;
 
@@ -666,20 +744,78 @@ LRESULT MainWindow::windowProc(unsigned int message, WPARAM wParam, LPARAM lPara
 					info.fState ^= MFS_CHECKED;
 					winrt::check_bool(SetMenuItemInfoW(menu, wParam, TRUE, &info));
 					enabledUnknownTerritories = info.fState & MFS_CHECKED;
+					refilter();
 				}
 				break;
 
 				case ID_MAIN_MENU_VIEW_DATE_LOCALE:
 				{
-					dateTimeFormat = DateTimeFormat::LOCALE;
-					updateDateTimeMenuItems();
+					store->dateTimeFormat = DateTimeFormat::LOCALE;
+					for(MainWindow *i : store->views) {
+						i->updateDateTimeMenuItems();
+					}
 				}
 				break;
 
 				case ID_MAIN_MENU_VIEW_DATE_ISO8601:
 				{
-					dateTimeFormat = DateTimeFormat::ISO_8601;
-					updateDateTimeMenuItems();
+					store->dateTimeFormat = DateTimeFormat::ISO_8601;
+					for(MainWindow *i : store->views) {
+						i->updateDateTimeMenuItems();
+					}
+				}
+				break;
+
+				case ID_MAIN_MENU_VIEW_HISTORY:
+				{
+					info.fMask = MIIM_STATE;
+					info.fState ^= MFS_CHECKED;
+					winrt::check_bool(SetMenuItemInfoW(menu, wParam, TRUE, &info));
+					setHistoryShown(info.fState & MFS_CHECKED);
+				}
+				break;
+
+				case ID_MAIN_MENU_VIEW_HISTORY_MEMORY_OFF:
+				case ID_MAIN_MENU_VIEW_HISTORY_MEMORY_256K:
+				case ID_MAIN_MENU_VIEW_HISTORY_MEMORY_1M:
+				case ID_MAIN_MENU_VIEW_HISTORY_MEMORY_4M:
+				{
+					// Resizing the pool discards every train's history, so only do it if the size actually changes.
+					for(const auto &[id, budget] : historyBudgets) {
+						if(id == info.wID && budget != store->histories.budget()) {
+							store->histories.reset(budget);
+						}
+					}
+					for(MainWindow *i : store->views) {
+						i->updateHistoryMenuItems();
+						InvalidateRect(i->trainsView, nullptr, FALSE);
+					}
+				}
+				break;
+
+				case ID_MAIN_MENU_VIEW_DIAGNOSTICS:
+				{
+					// Only one diagnostics window is needed; if it is already open, bring it to the front instead.
+					if(store->diagnosticsWindow && IsWindow(store->diagnosticsWindow)) {
+						SetForegroundWindow(store->diagnosticsWindow);
+					} else {
+						// Most sessions never open diagnostics, so the window class is only registered the first time it is needed, rather than at startup.
+						static const util::WindowClassRegistration diagnosticsClassRegistration = [this]() {
+							WNDCLASSEXW windowClass{};
+							windowClass.cbSize = sizeof(windowClass);
+							windowClass.lpfnWndProc = &trainlist8::Window::windowProcThunk;
+							windowClass.hInstance = instance();
+							windowClass.hCursor = static_cast<HCURSOR>(util::loadImage(nullptr, IDC_ARROW, IMAGE_CURSOR, 0, 0, LR_DEFAULTSIZE | LR_SHARED));
+							windowClass.hbrBackground = reinterpret_cast<HBRUSH>(COLOR_BTNFACE + 1);
+							windowClass.lpszClassName = DiagnosticsWindow::windowClass;
+							return util::WindowClassRegistration(windowClass);
+						}();
+						diagnosticsClassRegistration;
+						store->diagnosticsWindow = trainlist8::Window::create(WS_EX_WINDOWEDGE, DiagnosticsWindow::windowClass, util::loadString(instance(), IDS_DIAGNOSTICS_TITLE).c_str(), WS_CAPTION | WS_MAXIMIZEBOX | WS_MINIMIZEBOX | WS_OVERLAPPED | WS_SIZEBOX | WS_SYSMENU, CW_USEDEFAULT, 0, 900, 450, *this, nullptr, instance(), [this](HWND handle) {
+							return new DiagnosticsWindow(handle, pump, store->latencyRecorder, store->throughputSampler);
+						});
+						winrt::check_bool(ShowWindowAsync(store->diagnosticsWindow, SW_SHOWNORMAL));
+					}
 				}
 				break;
 			}
@@ -695,7 +831,10 @@ LRESULT MainWindow::windowProc(unsigned int message, WPARAM wParam, LPARAM lPara
 					{
 						const NMLISTVIEW &info = *reinterpret_cast<const NMLISTVIEW *>(lParam);
 						unsigned int clickedColumn = info.iSubItem;
-						if(clickedColumn == sortColumn) {
+						if(clickedColumn >= columnMetadata.size()) {
+							// The speed history column cannot be sorted by.
+							return 0;
+						} else if(clickedColumn == sortColumn) {
 							sortOrder *= -1;
 						} else {
 							sortColumn = clickedColumn;
@@ -709,12 +848,15 @@ LRESULT MainWindow::windowProc(unsigned int message, WPARAM wParam, LPARAM lPara
 					case LVN_GETDISPINFO:
 					{
 						NMLVDISPINFO &info = *reinterpret_cast<NMLVDISPINFO *>(lParam);
-						const TrainInfo &train = *reinterpret_cast<const TrainInfo *>(info.item.lParam);
-						if(info.item.mask & LVIF_TEXT) {
-							info.item.pszText = const_cast<wchar_t *>(columnMetadata[info.item.iSubItem]->text(train, getDispInfoBuffers).c_str());
+						TrainInfo &train = *reinterpret_cast<TrainInfo *>(info.item.lParam);
+						if((info.item.mask & LVIF_TEXT) && static_cast<size_t>(info.item.iSubItem) < columnMetadata.size()) {
+							info.item.pszText = const_cast<wchar_t *>(cellText(train, info.item.iSubItem));
 						}
 					}
 					return 0;
+
+					case NM_CUSTOMDRAW:
+						return customDrawTrains(*reinterpret_cast<const NMLVCUSTOMDRAW *>(lParam));
 				}
 			}
 		}
@@ -724,6 +866,16 @@ LRESULT MainWindow::windowProc(unsigned int message, WPARAM wParam, LPARAM lPara
 			updateLayout();
 			return 0;
 
+		case WM_TIMER:
+			if(wParam == statusTimerID) {
+				// Every view runs the timer so that the status keeps refreshing whichever views are closed, but only the oldest samples the counters, so that each rate covers a whole interval.
+				if(store->views.front() == this) {
+					store->updateStatus();
+				}
+				return 0;
+			}
+			break;
+
 	}
 	return DefWindowProc(*this, message, wParam, lParam);
 }
@@ -751,10 +903,177 @@ HMENU MainWindow::findSubMenuContainingID(HMENU parent, unsigned int id) {
 	return nullptr;
 };
 
+// Closes this view.
+//
+// The last view cannot go until the receive loops have ended, because until then they may still touch it; closing it stops them instead, and it is destroyed once they have.
 void MainWindow::handleClose() {
-	if(!closing) {
-		closing = true;
-		receiveMessagesAction.Cancel();
+	if(store->views.size() > 1) {
+		DestroyWindow(*this);
+	} else {
+		store->close();
+	}
+}
+
+// Opens another view of the same trains, with its own filters and sort order.
+void MainWindow::openView() {
+	HWND view = trainlist8::Window::create(WS_EX_WINDOWEDGE, windowClass, util::loadString(instance(), IDS_APP_NAME).c_str(), WS_CAPTION | WS_MAXIMIZEBOX | WS_MINIMIZEBOX | WS_OVERLAPPED | WS_SIZEBOX | WS_SYSMENU, CW_USEDEFAULT, 0, 1000, 500, nullptr, nullptr, instance(), [this](HWND handle) {
+		return new MainWindow(handle, pump, store);
+	});
+	winrt::check_bool(ShowWindowAsync(view, SW_SHOWNORMAL));
+}
+
+// Fills the View/Territories menu with one item per territory in the current location database, replacing any that are already there.
+void MainWindow::populateTerritoriesMenu() {
+	// Find the View/Territories menu. It doesn't have an ID because submenus can't have IDs, so we must search for it by knowing that it contains the Unknown item, which does have an ID.
+	HMENU bar = winrt::check_pointer(GetMenu(*this));
+	HMENU viewMenu = winrt::check_pointer(findSubMenuContainingID(bar, ID_MAIN_MENU_VIEW_TERRITORIES_UNKNOWN));
+	HMENU territoriesMenu = winrt::check_pointer(findSubMenuContainingID(viewMenu, ID_MAIN_MENU_VIEW_TERRITORIES_UNKNOWN));
+
+	// Remove the items for the territories in the previous database, if any.
+	while(DeleteMenu(territoriesMenu, ID_MAIN_MENU_VIEW_TERRITORIES_SPECIFIC, MF_BYCOMMAND));
+
+	// Build the list of strings that will be added to it, which is the territory names but in sorted order, and add them. Give each menu item a dwItemData that is the territory ID. Insert these items before the Unknown item.
+	const database::Database &db = database::current();
+	std::vector<std::pair<std::wstring_view, unsigned int>> sortedStrings;
+	sortedStrings.reserve(db.territories().size());
+	for(const database::Territory &i : db.territories()) {
+		sortedStrings.emplace_back(db.name(i), i.id);
+	}
+	std::sort(sortedStrings.begin(), sortedStrings.end());
+	for(size_t i = 0; i != sortedStrings.size(); ++i) {
+		MENUITEMINFOW info{
+			.cbSize = sizeof(info),
+			.fMask = MIIM_DATA | MIIM_FTYPE | MIIM_ID | MIIM_STATE | MIIM_STRING,
+			.fType = MFT_STRING,
+			.fState = static_cast<UINT>(disabledTerritories[sortedStrings[i].second] ? MFS_UNCHECKED : MFS_CHECKED),
+			.wID = ID_MAIN_MENU_VIEW_TERRITORIES_SPECIFIC,
+			.dwItemData = sortedStrings[i].second,
+			.dwTypeData = const_cast<wchar_t *>(sortedStrings[i].first.data()),
+		};
+		winrt::check_bool(InsertMenuItemW(territoriesMenu, static_cast<UINT>(i), TRUE, &info));
+	}
+}
+
+// Reloads the location database from disk and redisplays everything that depends on it in every view.
+//
+// If the new file cannot be loaded, the user is told why and the previous database stays in use.
+void MainWindow::reloadLocationDatabase() {
+	std::wstring path = database::defaultPath();
+	try {
+		database::load(path);
+	} catch(const winrt::hresult_error &exp) {
+		std::wstring message = exp.code() == error::invalidLocationDatabase ? util::loadString(instance(), IDS_ERROR_INVALID_LOCATION_DATABASE) : std::wstring(exp.message());
+		MessageBoxW(*this, util::loadAndFormatString(instance(), IDS_LOCATION_DATABASE_ERROR, message.c_str(), path.c_str()).c_str(), util::loadString(instance(), IDS_APP_NAME).c_str(), MB_OK | MB_ICONHAND);
+		return;
+	}
+
+	// Territories and locations are looked up from a train's block when an update message arrives, so the next message for each train must not be skipped as unchanged, every cell already formatted may show an old name, and territories may now sort differently.
+	for(std::pair<const uint64_t, TrainInfo> &i : store->trains) {
+		i.second.fingerprint = 0;
+		i.second.staleCells.set();
+		i.second.sortKey = trains::sortKey(i.second);
+	}
+	for(MainWindow *i : store->views) {
+		i->populateTerritoriesMenu();
+		i->refilter();
+		ListView_SortItems(i->trainsView, &MainWindow::rawCompareCallback, reinterpret_cast<LPARAM>(i));
+		InvalidateRect(i->trainsView, nullptr, FALSE);
+	}
+}
+
+// Returns whether a train is in an enabled territory and matches the filter program.
+bool MainWindow::passesFilters(const TrainInfo &train) const {
+	bool inEnabledTerritory = train.territory && territory::nameByID(*train.territory) ? !disabledTerritories[*train.territory] : enabledUnknownTerritories;
+	return inEnabledTerritory && filterProgram.matches({
+		.symbol = train.symbol,
+		.railroadInitials = train.railroadInitials,
+		.engineerType = train.engineerType,
+		.speed = train.speed,
+		.block = train.block,
+	});
+}
+
+// Returns the position at which a train should be inserted in the list to keep it sorted.
+//
+// If the train is already listed, oldIndex is its row, which is left out of the search because it may be out of place; the result is then the position among the other rows, which is where the row belongs once it has been removed. Otherwise, oldIndex is −1.
+int MainWindow::sortedIndex(const TrainInfo &train, int oldIndex) const {
+	using std::begin;
+	auto indexRange = std::ranges::views::iota(0, ListView_GetItemCount(trainsView) - (oldIndex >= 0 ? 1 : 0));
+	return static_cast<int>(std::ranges::lower_bound(
+		indexRange,
+		train,
+		[this](const TrainInfo &candidate, const TrainInfo &newTrain) -> bool {
+			return compareTrains(candidate, newTrain, sortColumn, sortOrder) < 0;
+		},
+		[this, oldIndex](const int &position) -> const TrainInfo & {
+			int candidateIndex = oldIndex >= 0 && position >= oldIndex ? position + 1 : position;
+			LVITEMW candidateItem = {.mask = LVIF_PARAM, .iItem = candidateIndex};
+			ListView_GetItem(trainsView, &candidateItem);
+			return *reinterpret_cast<const TrainInfo *>(candidateItem.lParam);
+		}) - begin(indexRange));
+}
+
+// Adds a row for a train at a given position in the list, with every column to be filled in on demand.
+void MainWindow::insertRow(TrainInfo &train, int index) {
+	LVITEMW item = {
+		.mask = LVIF_IMAGE | LVIF_PARAM,
+		.iItem = index,
+		.iImage = static_cast<int>(train.engineerType),
+		.lParam = reinterpret_cast<LPARAM>(&train),
+	};
+	ListView_InsertItem(trainsView, &item);
+	for(size_t i = 0; i != columnMetadata.size(); ++i) {
+		ListView_SetItemText(trainsView, index, i, LPSTR_TEXTCALLBACK);
+	}
+	rows.insert_or_assign(&train, ListView_MapIndexToID(trainsView, index));
+	startup::mark("FirstTrainRow");
+	startup::finish();
+}
+
+// Removes a train's row from the list, if it has one.
+void MainWindow::removeRow(const TrainInfo &train) {
+	if(auto row = rows.find(&train); row != rows.end()) {
+		ListView_DeleteItem(trainsView, ListView_MapIDToIndex(trainsView, row->second));
+		rows.erase(row);
+	}
+}
+
+// Decides again which trains pass the filters, after the filters have changed.
+//
+// Only the rows of trains whose visibility changed are added or removed; the rest of the list is left alone.
+void MainWindow::refilter() {
+	for(std::pair<const uint64_t, TrainInfo> &i : store->trains) {
+		bool visible = passesFilters(i.second);
+		bool listed = rows.contains(&i.second);
+		if(visible && !listed) {
+			insertRow(i.second, sortedIndex(i.second, -1));
+		} else if(!visible && listed) {
+			removeRow(i.second);
+		}
+	}
+}
+
+// Compiles the text in the filter box and, if it is valid, applies it to the list.
+//
+// If it is not valid, the previous filter stays in effect and a balloon points out where the problem is, so that a half-typed expression does not empty the list.
+void MainWindow::updateFilter() {
+	std::wstring text(GetWindowTextLengthW(filterEdit) + 1, L'\0');
+	text.resize(GetWindowTextW(filterEdit, text.data(), static_cast<int>(text.size())));
+	size_t errorPosition;
+	if(std::optional<filter::Program> program = filter::Program::compile(text, errorPosition); program) {
+		Edit_HideBalloonTip(filterEdit);
+		filterProgram = std::move(*program);
+		refilter();
+	} else {
+		std::wstring title = util::loadString(instance(), IDS_MAIN_FILTER_ERROR_TITLE);
+		std::wstring message = util::loadAndFormatString(instance(), IDS_MAIN_FILTER_ERROR, static_cast<unsigned int>(errorPosition + 1));
+		EDITBALLOONTIP tip{
+			.cbStruct = sizeof(tip),
+			.pszTitle = title.c_str(),
+			.pszText = message.c_str(),
+			.ttiIcon = TTI_WARNING,
+		};
+		Edit_ShowBalloonTip(filterEdit, &tip);
 	}
 }
 
@@ -765,183 +1084,181 @@ int WINAPI MainWindow::rawCompareCallback(LPARAM param1, LPARAM param2, LPARAM e
 	return compareTrains(train1, train2, self.sortColumn, self.sortOrder);
 }
 
+// Compares two trains by a column and, if they are equal in it, by their sort keys, so that the order is total.
 int MainWindow::compareTrains(const TrainInfo &x, const TrainInfo &y, unsigned int sortColumn, int sortOrder) {
-	return sortOrder * columnMetadata[sortColumn]->compare(x, y);
+	if(int ret = columnMetadata[sortColumn]->compare(x, y); ret) {
+		return sortOrder * ret;
+	}
+
+	return trains::compareTies(x, y);
 }
 
-winrt::Windows::Foundation::IAsyncAction MainWindow::receiveMessages() {
-	auto uiThread = winrt::Windows::System::DispatcherQueue::GetForCurrentThread();
-	auto cancelToken = co_await winrt::get_cancellation_token();
-	cancelToken.enable_propagation();
+// Brings a train's row up to date after the store has applied an update message to it.
+//
+// The store has already worked out which columns changed, so this only decides whether the train passes this view's filters and where it belongs in this view's sort order.
+void MainWindow::showTrain(TrainInfo &train, bool added, const ColumnSet &columnsChanged, bool historyChanged) {
+	auto row = rows.find(&train);
+	bool listed = row != rows.end();
+
+	// Decide whether the train should be listed. This only needs doing again if a field that the filters test has changed.
+	bool visible = listed;
+	if(added || filterInputsChanged(columnsChanged, filterProgram)) {
+		visible = passesFilters(train);
+	}
 
-	for(;;) {
-		co_await connection.receiveMessage();
-		Connection::Message message = *connection.lastMessage();
-		if(const soap::SimulationState **statePointer = std::get_if<const soap::SimulationState *>(&message)) {
-			const soap::SimulationState *state = *statePointer;
+	if(!visible) {
+		// The train is filtered out. Remove its row if it had one.
+		removeRow(train);
+	} else {
+		// Calculate where in the list the train should appear.
+		int oldIndex = listed ? ListView_MapIDToIndex(trainsView, row->second) : -1;
+		int newIndex;
+		if(!listed || columnsChanged[sortColumn] || sortKeyInputsChanged(columnsChanged)) {
+			// This train has just become visible or a value that decides its place in the list has changed. A new position needs to be calculated.
+			newIndex = sortedIndex(train, oldIndex);
+		} else {
+			// This is a listed train whose sorting keys have not changed. It will not move.
+			newIndex = oldIndex;
+		}
 
-			// Format the current date and time.
-			const wchar_t *datePicture = nullptr, *timePicture = nullptr;
-			uint32_t dateFlags = 0;
-			switch(dateTimeFormat) {
-				case DateTimeFormat::LOCALE:
-					datePicture = timePicture = nullptr;
-					dateFlags = DATE_AUTOLAYOUT | DATE_SHORTDATE;
-					break;
-				case DateTimeFormat::ISO_8601:
-					datePicture = L"yyyy'-'MM'-'dd";
-					timePicture = L"HH':'mm':'ss";
-					dateFlags = 0;
-					break;
-			}
-			FILETIME ft;
-			winrt::check_hresult(WsDateTimeToFileTime(&state->time, &ft, nullptr));
-			SYSTEMTIME st;
-			winrt::check_bool(FileTimeToSystemTime(&ft, &st));
-			int dateLen = GetDateFormatEx(LOCALE_NAME_USER_DEFAULT, dateFlags, &st, datePicture, nullptr, 0, nullptr);
-			if(!dateLen) {
-				OutputDebugStringW(L"date failed\n");
-				winrt::throw_last_error();
+		if(newIndex != oldIndex) {
+			// This train has just become visible, or else a value used for sorting has changed such that it must be repositioned in the list. Insert a row in the proper place, deleting the old row if applicable.
+			if(oldIndex >= 0) {
+				throughput::add(throughput::Counter::ROW_MOVES);
+				ListView_DeleteItem(trainsView, oldIndex);
 			}
-			int timeLen = GetTimeFormatEx(LOCALE_NAME_USER_DEFAULT, 0, &st, timePicture, nullptr, 0);
-			if(!timeLen) {
-				OutputDebugStringW(L"time failed\n");
-				winrt::throw_last_error();
-			}
-			std::wstring buffer(dateLen + 1 /* space */ + timeLen, L'\0');
-			dateLen = GetDateFormatEx(LOCALE_NAME_USER_DEFAULT, dateFlags, &st, datePicture, buffer.data(), buffer.size(), nullptr);
-			if(!dateLen) {
-				winrt::throw_last_error();
-			}
-			while(dateLen && buffer[dateLen - 1] == '\0') {
-				--dateLen;
-			}
-			assert(static_cast<unsigned int>(dateLen) + 1 < buffer.size());
-			buffer[dateLen] = L' ';
-			size_t timeStartPos = dateLen + 1;
-			timeLen = GetTimeFormatEx(LOCALE_NAME_USER_DEFAULT, 0, &st, timePicture, buffer.data() + timeStartPos, buffer.size() - timeStartPos);
-			if(!timeLen) {
-				winrt::throw_last_error();
+			insertRow(train, newIndex);
+		} else {
+			// Update all the columns that changed.
+			bool crewChanged = false;
+			for(size_t i = 0; i != columnMetadata.size(); ++i) {
+				if(columnsChanged[i]) {
+					ListView_SetItemText(trainsView, newIndex, i, LPSTR_TEXTCALLBACK);
+					if(columnMetadata[i] == &CrewColumn::instance) {
+						crewChanged = true;
+					}
+				}
 			}
-			buffer.resize(timeStartPos + timeLen);
-			while(!buffer.empty() && buffer.back() == L'\0') {
-				buffer.pop_back();
+			if(crewChanged) {
+				LVITEMW item = {
+					.mask = LVIF_IMAGE,
+					.iItem = newIndex,
+					.iImage = static_cast<int>(train.engineerType),
+				};
+				ListView_SetItem(trainsView, &item);
 			}
-
-			// Move to the UI thread to update UI controls and modify the trains map.
-			co_await uiThread;
-
-			// Show the current date and time.
-			winrt::check_bool(SetWindowTextW(timeLabel, buffer.c_str()));
-
-			// Age the trains, removing those over the threshold.
-			for(std::pair<const uint32_t, TrainInfo> &i : trains) {
-				++i.second.age;
-				if(i.second.age > ageThreshold) {
-					ListView_DeleteItem(trainsView, ListView_MapIDToIndex(trainsView, i.second.listViewID));
+			if(historyShown && historyChanged) {
+				RECT rect;
+				if(ListView_GetSubItemRect(trainsView, newIndex, historyColumn, LVIR_BOUNDS, &rect)) {
+					InvalidateRect(trainsView, &rect, FALSE);
 				}
 			}
-			std::erase_if(trains, [](const std::pair<const uint32_t, TrainInfo> &i) { return i.second.age > ageThreshold; });
-		} else if(const soap::TrainData **dataPointer = std::get_if<const soap::TrainData *>(&message)) {
-			const soap::TrainData *data = *dataPointer;
+		}
+	}
+}
 
-			// Move to the UI thread to update UI controls and modify the trains map.
-			co_await uiThread;
+// Returns the text to show in one of a train's cells.
+//
+// The numeric and ETA columns are formatted the first time a cell is shown after its value changes, and the result is kept in the train object, so repainting or scrolling through rows whose values have not changed only returns pointers. Cells for trains that are never scrolled into view are never formatted at all. Every other column returns a string held by the train object or a name from the location database, except for the fallbacks used when a territory or block has no name, which are formatted into the scratch buffers. The returned pointer is valid until this is next called.
+const wchar_t *MainWindow::cellText(TrainInfo &train, size_t column) {
+	const Column &metadata = *columnMetadata[column];
+	auto cached = std::ranges::find(cachedColumns, &metadata);
+	if(cached == cachedColumns.end()) {
+		return metadata.text(train, getDispInfoBuffers);
+	}
+	std::wstring &cell = train.cells[cached - cachedColumns.begin()];
+	if(train.staleCells[column]) {
+		cell = metadata.text(train, getDispInfoBuffers);
+		train.staleCells[column] = false;
+	}
+	return cell.c_str();
+}
 
-			// Check whether the train is in an enabled territory.
-			std::optional<unsigned int> territoryID = territory::idByBlock(data->block);
-			std::optional<size_t> territoryIndex = territoryID ? territory::indexByID(*territoryID) : std::nullopt;
-			bool inEnabledTerritory = territoryIndex ? enabledTerritories[*territoryIndex] : enabledUnknownTerritories;
-			if(inEnabledTerritory) {
-				// Add an element to the trains map.
-				auto [element, added] = trains.emplace(data->id, TrainInfo{});
-
-				// Zero the age of the train, because we just saw an update so it obviously still exists.
-				element->second.age = 0;
-
-				// Fill the data provided by Run 8, keeping track of which fields changed.
-				std::bitset<columnMetadata.size()> columnsChanged;
-				bool crewChanged = false;
-				for(size_t i = 0; i != columnMetadata.size(); ++i) {
-					columnsChanged[i] = columnMetadata[i]->update(element->second, *data);
-					if(columnMetadata[i] == &CrewColumn::instance) {
-						crewChanged = columnsChanged[i];
-					}
-				}
+// Adds or removes the speed history column.
+void MainWindow::setHistoryShown(bool shown) {
+	if(shown == historyShown) {
+		return;
+	}
+	if(shown) {
+		const std::wstring &label = util::loadString(instance(), IDS_MAIN_COLUMN_HISTORY);
+		LVCOLUMNW col = {
+			.mask = LVCF_WIDTH | LVCF_TEXT | LVCF_SUBITEM,
+			.cx = 150,
+			.pszText = const_cast<wchar_t *>(label.c_str()),
+			.iSubItem = historyColumn,
+		};
+		ListView_InsertColumn(trainsView, historyColumn, &col);
+	} else {
+		ListView_DeleteColumn(trainsView, historyColumn);
+	}
+	historyShown = shown;
+}
 
-				// Calculate where in the list the train should appear.
-				int oldIndex = added ? -1 : ListView_MapIDToIndex(trainsView, element->second.listViewID);
-				int newIndex;
-				if(added || columnsChanged[sortColumn]) {
-					// This is a new train or the value in the column by which the list is sorted has changed. A new position needs to be calculated.
-					using std::begin;
-					auto indexRange = std::ranges::views::iota(0, ListView_GetItemCount(trainsView));
-					newIndex = static_cast<int>(std::ranges::lower_bound(
-						indexRange,
-						element->second,
-						[this](const TrainInfo &candidate, const TrainInfo &newTrain) -> bool {
-							return compareTrains(candidate, newTrain, sortColumn, sortOrder) < 0;
-						},
-						[this](const int &candidateIndex) -> const TrainInfo & {
-							LVITEMW candidateItem = {.mask = LVIF_PARAM, .iItem = candidateIndex};
-							ListView_GetItem(trainsView, &candidateItem);
-							return *reinterpret_cast<const TrainInfo *>(candidateItem.lParam);
-						}) - begin(indexRange));
-				} else {
-					// This is an existing train whose sorting key has not changed. It will not move.
-					newIndex = oldIndex;
+// Handles a custom draw notification from the list view by drawing the speed history cells itself and leaving everything else to the list view.
+LRESULT MainWindow::customDrawTrains(const NMLVCUSTOMDRAW &info) {
+	switch(info.nmcd.dwDrawStage) {
+		case CDDS_PREPAINT:
+			return historyShown ? CDRF_NOTIFYITEMDRAW : CDRF_DODEFAULT;
+
+		case CDDS_ITEMPREPAINT:
+			return CDRF_NOTIFYSUBITEMDRAW;
+
+		case CDDS_ITEMPREPAINT | CDDS_SUBITEM:
+			if(info.iSubItem == historyColumn) {
+				int index = static_cast<int>(info.nmcd.dwItemSpec);
+				RECT rect;
+				if(ListView_GetSubItemRect(trainsView, index, historyColumn, LVIR_BOUNDS, &rect)) {
+					// Full-row selection is only highlighted while the list has the focus, so match that.
+					bool selected = GetFocus() == trainsView && (ListView_GetItemState(trainsView, index, LVIS_SELECTED) & LVIS_SELECTED);
+					drawHistory(info.nmcd.hdc, rect, *reinterpret_cast<const TrainInfo *>(info.nmcd.lItemlParam), selected);
 				}
+				return CDRF_SKIPDEFAULT;
+			}
+			return CDRF_DODEFAULT;
+	}
+	return CDRF_DODEFAULT;
+}
 
-				if(newIndex != oldIndex) {
-					// This is a new train, or else the value of the column used for sorting has changed such that it must be repositioned in the list. Insert a row in the proper place, deleting the old row if applicable.
-					if(oldIndex >= 0) {
-						ListView_DeleteItem(trainsView, oldIndex);
-						if(newIndex > oldIndex) {
-							--newIndex;
-						}
-					}
-					LVITEMW item = {
-						.mask = LVIF_IMAGE | LVIF_PARAM,
-						.iItem = newIndex,
-						.iImage = static_cast<int>(data->engineerType),
-						.lParam = reinterpret_cast<LPARAM>(&element->second),
-					};
-					ListView_InsertItem(trainsView, &item);
-					element->second.listViewID = ListView_MapIndexToID(trainsView, newIndex);
-
-					// All columns need to be updated.
-					columnsChanged.set();
-				}
+// Draws a train's speed history as a line across a cell, with the newest sample at the right and the fastest speed in the history at the top.
+void MainWindow::drawHistory(HDC dc, const RECT &rect, const TrainInfo &train, bool selected) {
+	FillRect(dc, &rect, GetSysColorBrush(selected ? COLOR_HIGHLIGHT : COLOR_WINDOW));
+	std::array<std::span<const history::Sample>, 2> runs = store->histories.samples(train.history);
+	size_t count = runs[0].size() + runs[1].size();
+	int margin = MulDiv(2, dpi(), USER_DEFAULT_SCREEN_DPI);
+	int left = rect.left + margin, right = rect.right - margin - 1, bottom = rect.bottom - margin - 1;
+	int height = bottom - (rect.top + margin);
+	if(count < 2 || right <= left || height <= 0) {
+		return;
+	}
 
-				// Update all the columns that changed.
-				for(size_t i = 0; i != columnMetadata.size(); ++i) {
-					if(columnsChanged[i]) {
-						ListView_SetItemText(trainsView, newIndex, i, LPSTR_TEXTCALLBACK);
-					}
-				}
-				if(crewChanged && newIndex == oldIndex) {
-					LVITEMW item = {
-						.mask = LVIF_IMAGE,
-						.iItem = newIndex,
-						.iImage = static_cast<int>(data->engineerType),
-					};
-					ListView_SetItem(trainsView, &item);
-				}
-			} else {
-				// See if we already have a record of this train, from when it was in a different territory or when this territory was previously enabled.
-				if(auto i = trains.find(data->id); i != trains.end()) {
-					ListView_DeleteItem(trainsView, ListView_MapIDToIndex(trainsView, i->second.listViewID));
-					trains.erase(i);
-				}
-			}
+	// Work out the points in a buffer that is kept from one cell to the next, so that painting does not allocate.
+	float scale = minimumHistoryScale;
+	for(std::span<const history::Sample> run : runs) {
+		for(const history::Sample &i : run) {
+			scale = std::max(scale, std::abs(i.speed));
 		}
 	}
+	historyPoints.clear();
+	int position = static_cast<int>(history::samplesPerTrain - count);
+	for(std::span<const history::Sample> run : runs) {
+		for(const history::Sample &i : run) {
+			historyPoints.push_back({
+				.x = left + MulDiv(position++, right - left, static_cast<int>(history::samplesPerTrain - 1)),
+				.y = bottom - static_cast<int>(std::lround(std::abs(i.speed) / scale * height)),
+			});
+		}
+	}
+
+	HGDIOBJ oldPen = SelectObject(dc, GetStockObject(DC_PEN));
+	SetDCPenColor(dc, GetSysColor(selected ? COLOR_HIGHLIGHTTEXT : COLOR_WINDOWTEXT));
+	Polyline(dc, historyPoints.data(), static_cast<int>(historyPoints.size()));
+	SelectObject(dc, oldPen);
 }
 
 void MainWindow::updateLayoutAndFont() {
 	// Set a good font.
 	std::unique_ptr<HFONT, util::FontDeleter> newFont = util::createMessageBoxFont(12, dpi());
-	for(HWND window : {timeFrame, timeLabel, trainsView}) {
+	for(HWND window : {timeFrame, timeLabel, statusLabel, filterLabel, filterEdit, trainsView}) {
 		SendMessage(window, WM_SETFONT, reinterpret_cast<WPARAM>(newFont.get()), TRUE);
 	}
 	font = std::move(newFont);
@@ -954,6 +1271,7 @@ void MainWindow::updateLayout() {
 	// Lay out the controls.
 	int margin = MulDiv(10, dpi(), USER_DEFAULT_SCREEN_DPI);
 	int rowHeight = MulDiv(25, dpi(), USER_DEFAULT_SCREEN_DPI);
+	int filterLabelWidth = MulDiv(50, dpi(), USER_DEFAULT_SCREEN_DPI);
 	RECT clientRect;
 	winrt::check_bool(GetClientRect(*this, &clientRect));
 	int clientWidth = clientRect.right - clientRect.left;
@@ -962,6 +1280,11 @@ void MainWindow::updateLayout() {
 	MoveWindow(timeFrame, margin, y, clientWidth - 2 * margin, rowHeight * 2, TRUE);
 	MoveWindow(timeLabel, margin, margin * 2, clientWidth - 4 * margin, rowHeight, TRUE);
 	y += rowHeight * 2 + margin;
+	MoveWindow(statusLabel, margin, y, clientWidth - 2 * margin, rowHeight, TRUE);
+	y += rowHeight;
+	MoveWindow(filterLabel, margin, y, filterLabelWidth, rowHeight, TRUE);
+	MoveWindow(filterEdit, margin + filterLabelWidth, y, clientWidth - 2 * margin - filterLabelWidth, rowHeight, TRUE);
+	y += rowHeight + margin;
 	MoveWindow(trainsView, margin, y, clientWidth - 2 * margin, clientHeight - y - margin, TRUE);
 }
 
@@ -992,7 +1315,7 @@ void MainWindow::updateDateTimeMenuItems() {
 	HMENU dateTimeMenu = winrt::check_pointer(findSubMenuContainingID(viewMenu, ID_MAIN_MENU_VIEW_DATE_LOCALE));
 
 	unsigned int checked = 0;
-	switch(dateTimeFormat) {
+	switch(store->dateTimeFormat) {
 		case DateTimeFormat::LOCALE:
 			checked = ID_MAIN_MENU_VIEW_DATE_LOCALE;
 			break;
@@ -1004,4 +1327,496 @@ void MainWindow::updateDateTimeMenuItems() {
 	if(!CheckMenuRadioItem(dateTimeMenu, ID_MAIN_MENU_VIEW_DATE_LOCALE, ID_MAIN_MENU_VIEW_DATE_ISO8601, checked, MF_BYCOMMAND)) {
 		winrt::throw_last_error();
 	}
+}
+
+void MainWindow::updateHistoryMenuItems() {
+	HMENU bar = winrt::check_pointer(GetMenu(*this));
+	HMENU viewMenu = winrt::check_pointer(findSubMenuContainingID(bar, ID_MAIN_MENU_VIEW_HISTORY_MEMORY_OFF));
+	HMENU memoryMenu = winrt::check_pointer(findSubMenuContainingID(viewMenu, ID_MAIN_MENU_VIEW_HISTORY_MEMORY_OFF));
+
+	unsigned int checked = 0;
+	for(const auto &[id, budget] : historyBudgets) {
+		if(budget == store->histories.budget()) {
+			checked = id;
+		}
+	}
+	if(!CheckMenuRadioItem(memoryMenu, historyBudgets.front().first, historyBudgets.back().first, checked, MF_BYCOMMAND)) {
+		winrt::throw_last_error();
+	}
+}
+
+// Shows a summary of the most recent sample of the throughput counters in the status label.
+void MainWindow::updateStatus() {
+	const throughput::Sampler &throughputSampler = store->throughputSampler;
+	double messages = 0;
+	for(size_t i = 0; i != throughput::actionCounterCount; ++i) {
+		messages += throughputSampler.rate(static_cast<throughput::Counter>(i));
+	}
+	double discarded = throughputSampler.rate(throughput::Counter::DTMF_MESSAGES) + throughputSampler.rate(throughput::Counter::RADIO_TEXT_MESSAGES) + throughputSampler.rate(throughput::Counter::SET_INTERLOCK_ERROR_SWITCHES_MESSAGES) + throughputSampler.rate(throughput::Counter::UNCHANGED_TRACK_STATE_MESSAGES) + throughputSampler.rate(throughput::Counter::MALFORMED_TRACK_STATE_MESSAGES) + throughputSampler.rate(throughput::Counter::STALE_SIMULATION_STATE_MESSAGES) + throughputSampler.rate(throughput::Counter::SHED_TRAIN_DATA_MESSAGES);
+	double ticks = throughputSampler.rate(throughput::Counter::SEND_SIMULATION_STATE_MESSAGES);
+	double expiredPerTick = ticks > 0 ? throughputSampler.rate(throughput::Counter::TRAINS_EXPIRED) / ticks : 0;
+	winrt::check_bool(SetWindowTextW(statusLabel, util::loadAndFormatString(instance(), IDS_MAIN_STATUS,
+		formatRate(messages).c_str(),
+		formatRate(discarded).c_str(),
+		static_cast<unsigned int>(store->trains.size()),
+		formatRate(expiredPerTick).c_str(),
+		formatRate(throughputSampler.rate(throughput::Counter::UI_FLUSHES)).c_str(),
+		formatRate(throughputSampler.rate(throughput::Counter::ROW_MOVES)).c_str()).c_str()));
+}
+
+// Creates a store that will receive from a set of connected servers once started.
+MainWindow::Store::Store(std::vector<Connection> connections) :
+	views(),
+	trains(),
+	histories(defaultHistoryBudget),
+	etaEngine(),
+	serverTimes(connections.size()),
+	closing(false),
+	connections(std::move(connections)),
+	receiveMessagesActions(),
+	runningReceivers(0),
+	serverStatus(this->connections.size()),
+	dateTimeFormat(DateTimeFormat::LOCALE),
+	latencyRecorder(),
+	throughputSampler(),
+	diagnosticsWindow(nullptr),
+	uiQueue(winrt::Windows::System::DispatcherQueue::GetForCurrentThread()),
+	pendingMutex(),
+	pendingTicks(this->connections.size()),
+	pendingUpdates(),
+	drainingTicks(this->connections.size()),
+	drainingUpdates(),
+	flushScheduled(false),
+	flushRequested() {
+}
+
+// Adds a view, which will be told about every train update from now on.
+void MainWindow::Store::attach(MainWindow &view) {
+	views.push_back(&view);
+}
+
+// Removes a view.
+void MainWindow::Store::detach(MainWindow &view) {
+	std::erase(views, &view);
+}
+
+// Starts receiving messages from each server, and registers for notification of completion of each receive-messages action.
+//
+// At least one view must be attached first.
+void MainWindow::Store::start() {
+	auto uiThread = winrt::Windows::System::DispatcherQueue::GetForCurrentThread();
+	for(size_t server = 0; server != connections.size(); ++server) {
+		receiveMessagesActions.push_back(receiveMessages(server));
+		++runningReceivers;
+		receiveMessagesActions.back().Completed([this, uiThread, server](const winrt::Windows::Foundation::IAsyncAction &action, winrt::Windows::Foundation::AsyncStatus status) {
+			// Capture the HRESULT, if there was one.
+			winrt::hresult_error error;
+			try {
+				action.GetResults();
+			} catch(const winrt::hresult_error &err) {
+				error = err;
+			}
+
+			// Dispatch on the UI thread to deal with the result.
+			uiThread.TryEnqueue([this, server, status, error]() {
+				handleReceiverFinished(server, status, error);
+				});
+			});
+	}
+}
+
+// Stops receiving messages. Every view is destroyed once the receive loops have ended.
+void MainWindow::Store::close() {
+	if(!closing) {
+		closing = true;
+		for(const winrt::Windows::Foundation::IAsyncAction &i : receiveMessagesActions) {
+			i.Cancel();
+		}
+	}
+}
+
+// Returns the statuses of all the servers, formatted for the time label.
+std::wstring MainWindow::Store::serverStatusText() const {
+	if(serverStatus.size() == 1) {
+		return serverStatus[0];
+	}
+	std::wstring text;
+	for(size_t i = 0; i != serverStatus.size(); ++i) {
+		if(i) {
+			text += L"    ";
+		}
+		text += connections[i].hostname();
+		text += L": ";
+		text += serverStatus[i];
+	}
+	return text;
+}
+
+// Samples the throughput counters and shows a summary of them in every view's status label.
+void MainWindow::Store::updateStatus() {
+	throughputSampler.sample();
+	for(MainWindow *i : views) {
+		i->updateStatus();
+	}
+}
+
+// Returns the module instance, for loading resources.
+//
+// While any receive loop is running there is at least one view, because the last view is only destroyed after they have all ended.
+HINSTANCE MainWindow::Store::instance() const {
+	return views.front()->instance();
+}
+
+// Handles the end of the receive-messages action for one server.
+//
+// The views are destroyed once every server's action has ended, because until then a receive loop may still touch them.
+void MainWindow::Store::handleReceiverFinished(size_t server, winrt::Windows::Foundation::AsyncStatus status, const winrt::hresult_error &error) {
+	switch(status) {
+		case winrt::Windows::Foundation::AsyncStatus::Completed:
+			// This should never happen; the receiveMessages function never returns normally.
+			std::abort();
+
+		case winrt::Windows::Foundation::AsyncStatus::Canceled:
+			// This is fine. This happens when the user closes the last view, or when another server failed.
+			break;
+
+		case winrt::Windows::Foundation::AsyncStatus::Error:
+		{
+			// We should show information about the error, then shut down the other servers' actions before terminating.
+			const winrt::hstring &hostname = connections[server].hostname();
+			if(error.code() == error::noDispatcherPermission) {
+				MessageBoxW(*views.front(), util::loadAndFormatString(instance(), IDS_MAIN_PERMISSION_RESCINDED, hostname.c_str()).c_str(), util::loadString(instance(), IDS_APP_NAME).c_str(), MB_OK | MB_ICONHAND);
+			} else {
+				MessageBoxW(*views.front(), util::loadAndFormatString(instance(), IDS_MAIN_CONNECTION_ERROR, error.message().c_str(), hostname.c_str()).c_str(), util::loadString(instance(), IDS_APP_NAME).c_str(), MB_OK | MB_ICONHAND);
+			}
+			close();
+		}
+		break;
+	}
+
+	// The application should terminate once all the actions have ended. Destroying the last view drops the last other reference to the store, so hold one until the views are all gone.
+	if(!--runningReceivers) {
+		std::shared_ptr<Store> self = shared_from_this();
+		std::vector<MainWindow *> remaining = views;
+		for(MainWindow *i : remaining) {
+			DestroyWindow(*i);
+		}
+	}
+}
+
+winrt::Windows::Foundation::IAsyncAction MainWindow::Store::receiveMessages(size_t server) {
+	auto uiThread = winrt::Windows::System::DispatcherQueue::GetForCurrentThread();
+	auto cancelToken = co_await winrt::get_cancellation_token();
+	cancelToken.enable_propagation();
+
+	std::minstd_rand generator(std::random_device{}());
+	for(;;) {
+		// Receive messages until the connection fails. Permission being rescinded is not a transient failure, so it ends the application rather than being retried.
+		winrt::hresult_error error;
+		try {
+			co_await receiveUpdates(server);
+		} catch(const winrt::hresult_error &err) {
+			if(cancelToken() || err.code() == error::noDispatcherPermission) {
+				throw;
+			}
+			error = err;
+		}
+
+		// Reconnect, backing off after each failed attempt. The trains map is left alone; trains still present in Run 8 will be updated in place once messages resume, while the rest age out as usual.
+		for(unsigned int failures = 0;; ++failures) {
+			std::chrono::milliseconds delay = reconnectDelay(failures, generator);
+			co_await uiThread;
+
+			// Apply whatever was received before the failure first, so that a waiting tick does not replace the status shown here.
+			flushUpdates();
+			setServerStatus(server, util::loadAndFormatString(instance(), IDS_MAIN_RECONNECTING, error.message().c_str(), static_cast<unsigned int>((delay.count() + 999) / 1000)));
+			co_await winrt::resume_after(delay);
+			try {
+				co_await connections[server].reconnect();
+				break;
+			} catch(const winrt::hresult_error &err) {
+				if(cancelToken() || err.code() == error::noDispatcherPermission) {
+					throw;
+				}
+				error = err;
+			}
+		}
+	}
+}
+
+// Receives messages from one server until the connection fails, handing them over to be applied on the UI thread.
+//
+// This never waits for the UI thread, so a busy or blocked UI thread does not stop the connection being drained and leave Run 8 to give up on it. Instead, whatever is received while the UI thread is busy waits for it in a buffer that stays bounded: each train and each server's clock only ever have their latest state waiting.
+winrt::Windows::Foundation::IAsyncAction MainWindow::Store::receiveUpdates(size_t server) {
+	auto cancelToken = co_await winrt::get_cancellation_token();
+	cancelToken.enable_propagation();
+
+	Connection &connection = connections[server];
+	for(;;) {
+		co_await connection.receiveMessage();
+		Connection::Message message = *connection.lastMessage();
+		latency::Timestamps timestamps = connection.lastMessageTimestamps();
+		if(const soap::SimulationState **statePointer = std::get_if<const soap::SimulationState *>(&message)) {
+			const soap::SimulationState *state = *statePointer;
+
+			// Format the current date and time.
+			const wchar_t *datePicture = nullptr, *timePicture = nullptr;
+			uint32_t dateFlags = 0;
+			switch(dateTimeFormat) {
+				case DateTimeFormat::LOCALE:
+					datePicture = timePicture = nullptr;
+					dateFlags = DATE_AUTOLAYOUT | DATE_SHORTDATE;
+					break;
+				case DateTimeFormat::ISO_8601:
+					datePicture = L"yyyy'-'MM'-'dd";
+					timePicture = L"HH':'mm':'ss";
+					dateFlags = 0;
+					break;
+			}
+			FILETIME ft;
+			winrt::check_hresult(WsDateTimeToFileTime(&state->time, &ft, nullptr));
+			SYSTEMTIME st;
+			winrt::check_bool(FileTimeToSystemTime(&ft, &st));
+			int dateLen = GetDateFormatEx(LOCALE_NAME_USER_DEFAULT, dateFlags, &st, datePicture, nullptr, 0, nullptr);
+			if(!dateLen) {
+				OutputDebugStringW(L"date failed\n");
+				winrt::throw_last_error();
+			}
+			int timeLen = GetTimeFormatEx(LOCALE_NAME_USER_DEFAULT, 0, &st, timePicture, nullptr, 0);
+			if(!timeLen) {
+				OutputDebugStringW(L"time failed\n");
+				winrt::throw_last_error();
+			}
+			std::wstring buffer(dateLen + 1 /* space */ + timeLen, L'\0');
+			dateLen = GetDateFormatEx(LOCALE_NAME_USER_DEFAULT, dateFlags, &st, datePicture, buffer.data(), buffer.size(), nullptr);
+			if(!dateLen) {
+				winrt::throw_last_error();
+			}
+			while(dateLen && buffer[dateLen - 1] == '\0') {
+				--dateLen;
+			}
+			assert(static_cast<unsigned int>(dateLen) + 1 < buffer.size());
+			buffer[dateLen] = L' ';
+			size_t timeStartPos = dateLen + 1;
+			timeLen = GetTimeFormatEx(LOCALE_NAME_USER_DEFAULT, 0, &st, timePicture, buffer.data() + timeStartPos, buffer.size() - timeStartPos);
+			if(!timeLen) {
+				winrt::throw_last_error();
+			}
+			buffer.resize(timeStartPos + timeLen);
+			while(!buffer.empty() && buffer.back() == L'\0') {
+				buffer.pop_back();
+			}
+
+			// Leave the tick for the UI thread to pick up, and go straight back to receiving.
+			queueTick(server, std::move(buffer), state->time.ticks, timestamps);
+		} else {
+			// Leave the update for the UI thread to pick up, and go straight back to receiving.
+			queueUpdate(server, *std::get<const soap::TrainData *>(message), timestamps);
+		}
+
+		// Close the batch at each tick. Every message in it has been copied into the pending queues or counted by now, so its memory can be reused.
+		if(std::holds_alternative<const soap::SimulationState *>(message)) {
+			connection.endBatch();
+		}
+	}
+}
+
+// Queues a simulation state tick to be applied on the UI thread, replacing any tick from the same server that is still waiting.
+//
+// This may be called from any thread. A replaced tick is stale, as its time has already been superseded, but it still counts towards the ages of the server's trains when the latest one is applied.
+void MainWindow::Store::queueTick(size_t server, std::wstring status, uint64_t time, const latency::Timestamps &timestamps) {
+	bool schedule;
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		PendingTick &tick = pendingTicks[server];
+		if(tick.count) {
+			throughput::add(throughput::Counter::STALE_SIMULATION_STATE_MESSAGES);
+		}
+		tick.status = std::move(status);
+		tick.time = time;
+		++tick.count;
+		tick.timestamps = timestamps;
+		schedule = requestFlush();
+	}
+	if(schedule) {
+		enqueueFlush();
+	}
+}
+
+// Queues a train update to be applied on the UI thread, replacing any update for the same train that is still waiting.
+//
+// This may be called from any thread. When Run 8 sends a burst of updates, a train mentioned several times before the UI thread gets round to it is therefore only applied once, with its latest values. Applying the latest values compares them against what is shown, so the columns marked as changed are exactly those that any of the folded updates would have changed.
+//
+// Coalescing bounds the number of waiting updates by the number of trains. As a backstop against train IDs churning while the UI thread is stalled, an update for a train that has nothing waiting is shed once pendingUpdateLimit trains do; the train's next update after the UI thread catches up brings it up to date.
+void MainWindow::Store::queueUpdate(size_t server, const soap::TrainData &data, const latency::Timestamps &timestamps) {
+	bool schedule;
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		uint64_t key = trainKey(server, data.id);
+		auto element = pendingUpdates.find(key);
+		if(element != pendingUpdates.end()) {
+			throughput::add(throughput::Counter::FOLDED_TRAIN_DATA_MESSAGES);
+		} else if(pendingUpdates.size() >= pendingUpdateLimit) {
+			throughput::add(throughput::Counter::SHED_TRAIN_DATA_MESSAGES);
+			return;
+		} else {
+			element = pendingUpdates.try_emplace(key).first;
+		}
+		PendingUpdate &update = element->second;
+		update.server = server;
+		update.data = data;
+		update.railroadInitials = data.railroadInitials;
+		update.symbol = data.symbol;
+		update.engineerName = data.engineerName;
+		update.timestamps = timestamps;
+		schedule = requestFlush();
+	}
+	if(schedule) {
+		enqueueFlush();
+	}
+}
+
+// Notes that something is waiting to be applied, returning whether a flush needs to be enqueued because none is yet.
+//
+// pendingMutex must be held.
+bool MainWindow::Store::requestFlush() {
+	if(flushScheduled) {
+		return false;
+	}
+	flushScheduled = true;
+	flushRequested = latency::Clock::now();
+	return true;
+}
+
+// Asks the UI thread to apply everything waiting for it.
+void MainWindow::Store::enqueueFlush() {
+	bool enqueued = uiQueue.TryEnqueue([self = shared_from_this()]() {
+		self->flushUpdates();
+	});
+	if(!enqueued) {
+		// The UI thread is shutting down, so the flush will never run. Clear the flag, so that the next thing queued tries again instead of waiting forever for this one.
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		flushScheduled = false;
+	}
+}
+
+// Applies every queued tick and train update.
+//
+// This must be called on the UI thread. Ticks are applied before updates, so that a train updated at any point since the last flush ends up with an age of zero rather than being aged by a tick that it may have come after.
+//
+// The waiting ticks and updates are swapped with the draining containers, which are emptied again once they have been applied. The two sets of containers therefore take turns, and each keeps its allocations, including the update map's buckets, from one flush to the next.
+void MainWindow::Store::flushUpdates() {
+	latency::Clock::time_point dispatched = latency::Clock::now();
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		if(!flushScheduled) {
+			return;
+		}
+		drainingTicks.swap(pendingTicks);
+		drainingUpdates.swap(pendingUpdates);
+		flushScheduled = false;
+		latencyRecorder.recordStall(dispatched - flushRequested);
+	}
+	throughput::add(throughput::Counter::UI_FLUSHES);
+	for(size_t server = 0; server != drainingTicks.size(); ++server) {
+		PendingTick &tick = drainingTicks[server];
+		if(tick.count) {
+			tick.timestamps.dispatched = dispatched;
+			applyTick(server, tick);
+			tick.count = 0;
+		}
+	}
+	for(std::pair<const uint64_t, PendingUpdate> &i : drainingUpdates) {
+		i.second.timestamps.dispatched = dispatched;
+		applyUpdate(i.second);
+	}
+	drainingUpdates.clear();
+}
+
+// Applies one server's latest simulation state tick: shows its time, and ages its trains by the number of ticks received, removing those over the threshold.
+void MainWindow::Store::applyTick(size_t server, PendingTick &tick) {
+	latency::Timestamps &timestamps = tick.timestamps;
+
+	// Show the current date and time, and remember it for the trains' histories.
+	setServerStatus(server, std::move(tick.status));
+	serverTimes[server] = tick.time;
+	timestamps.applied = latency::Clock::now();
+
+	// Age this server's trains, removing those over the threshold.
+	trains::age(trains, server, tick.count, [this](TrainInfo &train) {
+		for(MainWindow *view : views) {
+			view->removeRow(train);
+		}
+		histories.release(train.history);
+		throughput::add(throughput::Counter::TRAINS_EXPIRED);
+	});
+	timestamps.invalidated = latency::Clock::now();
+	latencyRecorder.record(latency::MessageType::SIMULATION_STATE, timestamps);
+}
+
+// Applies one train update to the trains map and every view.
+void MainWindow::Store::applyUpdate(PendingUpdate &update) {
+	size_t server = update.server;
+	latency::Timestamps &timestamps = update.timestamps;
+	soap::TrainData &data = update.data;
+	data.railroadInitials = update.railroadInitials.c_str();
+	data.symbol = update.symbol.c_str();
+	data.engineerName = update.engineerName.c_str();
+
+	// Add an element to the trains map. Trains that the filters hide are kept too, so that they can be shown straight away if the filters change.
+	auto [element, added] = trains.emplace(trainKey(server, data.id), TrainInfo{});
+	TrainInfo &train = element->second;
+	if(added) {
+		train.server = server;
+		train.id = data.id;
+		train.serverName = connections[server].hostname();
+	}
+
+	// Zero the age of the train, because we just saw an update so it obviously still exists.
+	train.age = 0;
+
+	// A message identical to the last one for this train cannot have changed any field taken from the message, which for a parked train is nearly every message.
+	bool unchanged = !added && train.fingerprint == data.fingerprint;
+	train.fingerprint = data.fingerprint;
+	if(unchanged) {
+		throughput::add(throughput::Counter::UNCHANGED_TRAIN_DATA_MESSAGES);
+	}
+
+	// Learn from the train's movement and predict when it will reach its next location. This comes first so that the columns can pick up the prediction.
+	etaEngine.update(train.progress, data.block, serverTimes[server], eta::classify(data.length, data.weight, data.horsepowerPerTon));
+
+	// Fill the data provided by Run 8, keeping track of which fields changed. Only the predicted columns can change if the message is unchanged.
+	ColumnSet columnsChanged;
+	for(size_t i = 0; i != columnMetadata.size(); ++i) {
+		if(!unchanged || std::ranges::find(predictedColumns, columnMetadata[i]) != predictedColumns.end()) {
+			columnsChanged[i] = columnMetadata[i]->update(train, data);
+		}
+	}
+	train.staleCells |= columnsChanged;
+	if(added || sortKeyInputsChanged(columnsChanged)) {
+		train.sortKey = trains::sortKey(train);
+	}
+
+	// Record the train's speed and position. A new train may take the slot of the history that has been kept longest, but a train whose history was evicted only gets another slot once one is free, so that a full pool does not trade slots back and forth on every message.
+	if(!histories.contains(train.history)) {
+		train.history = histories.allocate(added);
+	}
+	histories.record(train.history, {.time = serverTimes[server], .speed = data.speed, .block = data.block});
+	timestamps.applied = latency::Clock::now();
+
+	// Hand the changes to every view.
+	for(MainWindow *view : views) {
+		view->showTrain(train, added, columnsChanged, histories.contains(train.history));
+	}
+	timestamps.invalidated = latency::Clock::now();
+	latencyRecorder.record(latency::MessageType::TRAIN_DATA, timestamps);
+}
+
+// Records the status of one server, which is normally its current simulation time, and shows the statuses of all the servers in every view's time label.
+void MainWindow::Store::setServerStatus(size_t server, std::wstring status) {
+	serverStatus[server] = std::move(status);
+	std::wstring text = serverStatusText();
+	for(MainWindow *i : views) {
+		winrt::check_bool(SetWindowTextW(i->timeLabel, text.c_str()));
+	}
 }
\ No newline at end of file
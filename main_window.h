@@ -3,13 +3,23 @@
 #if !defined(MAIN_WINDOW_H)
 #define MAIN_WINDOW_H
 
+#include <array>
 #include <atomic>
 #include <bitset>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include "connection.h"
-#include "territory.h"
+#include "database.h"
+#include "eta.h"
+#include "filter.h"
+#include "history.h"
+#include "latency.h"
+#include "text_format.h"
+#include "throughput.h"
 #include "window.h"
 
 namespace trainlist8 {
@@ -22,10 +32,22 @@ enum class EngineerType : int32_t;
 
 class MainWindow final : public Window {
 	public:
+	// The number of text columns in the list, which excludes the speed history column.
+	static constexpr size_t columnCount = 12;
+
+	// The number of columns whose formatted text is kept in each train object; see TrainInfo::cells.
+	static constexpr size_t cellCount = 5;
+
 	// Information about a train that is saved persistently and made available for display.
 	struct TrainInfo final {
-		// The Windows list view ID number.
-		unsigned int listViewID;
+		// The index of the Run 8 server the train is on.
+		size_t server;
+
+		// The ID of the train within its Run 8 server.
+		uint32_t id;
+
+		// The name of the Run 8 server the train is on, for display.
+		std::wstring serverName;
 
 		// The type of driver.
 		soap::EngineerType engineerType;
@@ -36,9 +58,18 @@ class MainWindow final : public Window {
 		// How many simulation state messages have been received since the last update message for this train.
 		unsigned int age;
 
+		// The fingerprint of the last update message for this train.
+		uint64_t fingerprint;
+
 		// The lead unit name.
 		std::wstring leadUnit;
 
+		// The railroad initials of the lead unit.
+		std::wstring railroadInitials;
+
+		// The number of the lead unit.
+		uint32_t locomotiveNumber;
+
 		// The train symbol.
 		std::wstring symbol;
 
@@ -62,23 +93,35 @@ class MainWindow final : public Window {
 
 		// The block ID that the train most recently occupied that has a known name.
 		int32_t lastNamedBlock = -1;
-	};
 
-	// Scratch buffers used internally during text formatting.
-	struct ScratchBuffers final {
-		// A string buffer.
-		std::string string;
+		// The train's recent speeds and positions.
+		history::Handle history;
+
+		// What the ETA engine knows about the train's progress, including its latest prediction.
+		eta::Tracker progress;
+
+		// The block ID of the next named location ahead of the train, or −1 if it cannot be predicted.
+		int32_t nextLocation = -1;
+
+		// How long the train is expected to take to reach the next named location, in seconds, or an empty optional if it cannot be predicted.
+		std::optional<uint32_t> etaSeconds;
 
-		// A wstring buffer.
-		std::wstring wstring;
+		// The formatted text of the numeric and ETA columns, so that repainting a row does not format them again. Other columns' text is already held in one of the members above or in the location database.
+		std::array<std::wstring, cellCount> cells;
 
-		// Another wstring buffer.
-		std::wstring wstring2;
+		// The train's territory, location and the start of its symbol packed into one integer, which orders it among trains that are equal in the column the list is sorted by.
+		uint64_t sortKey;
+
+		// Which columns' entries in cells must be formatted again before they are next shown, because the value has changed or has never been formatted, indexed by column. Bits for columns without an entry in cells are ignored.
+		std::bitset<columnCount> staleCells = std::bitset<columnCount>().set();
 	};
 
+	// Scratch buffers used internally during text formatting.
+	using ScratchBuffers = text_format::ScratchBuffers;
+
 	static const wchar_t windowClass[];
 
-	explicit MainWindow(HWND handle, MessagePump &pump, Connection connection);
+	explicit MainWindow(HWND handle, MessagePump &pump, std::vector<Connection> connections);
 
 	protected:
 	LRESULT windowProc(unsigned int message, WPARAM wParam, LPARAM lParam) override;
@@ -89,31 +132,136 @@ class MainWindow final : public Window {
 		ISO_8601,
 	};
 
-	std::unordered_map<uint32_t, TrainInfo> trains;
+	// A set of columns, indexed by their positions in the list.
+	using ColumnSet = std::bitset<columnCount>;
+
+	// The connections and trains shared by every view of the same Run 8 servers.
+	//
+	// Each message is decoded and compared against its train's previous state once, here, and the result is then handed to every view, each of which keeps its own filters and sort order.
+	class Store final : public std::enable_shared_from_this<Store> {
+		public:
+		explicit Store(std::vector<Connection> connections);
+
+		void attach(MainWindow &view);
+		void detach(MainWindow &view);
+		void start();
+		void close();
+		std::wstring serverStatusText() const;
+		void updateStatus();
+
+		private:
+		friend class MainWindow;
+
+		// The latest simulation state tick from a server that has been received but not yet applied.
+		struct PendingTick final {
+			// The server's time, formatted for display.
+			std::wstring status;
+
+			// The server's time, in the 100-nanosecond ticks of a WS_DATETIME.
+			uint64_t time = 0;
+
+			// How many ticks have been received since the last one applied, or zero if there is none waiting.
+			unsigned int count = 0;
+
+			// When the latest tick was received and decoded.
+			latency::Timestamps timestamps;
+		};
+
+		// A train update that has been received but not yet applied.
+		struct PendingUpdate final {
+			// The index of the server the update came from.
+			size_t server;
+
+			// The update. Its string pointers are only filled in, pointing at the strings below, when it is applied.
+			soap::TrainData data;
+
+			// The railroad initials, symbol and engineer name, which must outlive the message they came from.
+			std::wstring railroadInitials, symbol, engineerName;
+
+			// When the update was received and decoded.
+			latency::Timestamps timestamps;
+		};
+
+		std::vector<MainWindow *> views;
+		std::unordered_map<uint64_t, TrainInfo> trains;
+		history::Pool histories;
+		eta::Engine etaEngine;
+		std::vector<uint64_t> serverTimes;
+		bool closing;
+		std::vector<Connection> connections;
+		std::vector<winrt::Windows::Foundation::IAsyncAction> receiveMessagesActions;
+		size_t runningReceivers;
+		std::vector<std::wstring> serverStatus;
+		std::atomic<DateTimeFormat> dateTimeFormat;
+		latency::Recorder latencyRecorder;
+		throughput::Sampler throughputSampler;
+		HWND diagnosticsWindow;
+		winrt::Windows::System::DispatcherQueue uiQueue;
+		std::mutex pendingMutex;
+		std::vector<PendingTick> pendingTicks;
+		std::unordered_map<uint64_t, PendingUpdate> pendingUpdates;
+		std::vector<PendingTick> drainingTicks;
+		std::unordered_map<uint64_t, PendingUpdate> drainingUpdates;
+		bool flushScheduled;
+		latency::Clock::time_point flushRequested;
+
+		HINSTANCE instance() const;
+		void handleReceiverFinished(size_t server, winrt::Windows::Foundation::AsyncStatus status, const winrt::hresult_error &error);
+		winrt::Windows::Foundation::IAsyncAction receiveMessages(size_t server);
+		winrt::Windows::Foundation::IAsyncAction receiveUpdates(size_t server);
+		void queueTick(size_t server, std::wstring status, uint64_t time, const latency::Timestamps &timestamps);
+		void queueUpdate(size_t server, const soap::TrainData &data, const latency::Timestamps &timestamps);
+		bool requestFlush();
+		void enqueueFlush();
+		void flushUpdates();
+		void applyTick(size_t server, PendingTick &tick);
+		void applyUpdate(PendingUpdate &update);
+		void setServerStatus(size_t server, std::wstring status);
+	};
+
+	std::shared_ptr<Store> store;
+	std::unordered_map<const TrainInfo *, unsigned int> rows;
 	std::unique_ptr<HIMAGELIST, util::ImageListDeleter> driverImageList;
 	std::unique_ptr<HFONT, util::FontDeleter> font;
-	HWND timeFrame, timeLabel, trainsView;
+	HWND timeFrame, timeLabel, statusLabel, filterLabel, filterEdit, trainsView;
 	ScratchBuffers getDispInfoBuffers;
 	unsigned int sortColumn;
 	int sortOrder;
 	size_t maxTextSize;
-	bool closing;
-	Connection connection;
-	winrt::Windows::Foundation::IAsyncAction receiveMessagesAction;
-	std::bitset<territory::count> enabledTerritories;
+	std::bitset<database::territoryIDLimit> disabledTerritories;
 	bool enabledUnknownTerritories;
-	std::atomic<DateTimeFormat> dateTimeFormat;
+	filter::Program filterProgram;
+	bool historyShown;
+	std::vector<POINT> historyPoints;
+	bool menusPopulated;
 
 	static HMENU findSubMenuContainingID(HMENU parent, unsigned int id);
 
+	explicit MainWindow(HWND handle, MessagePump &pump, std::shared_ptr<Store> store);
+
 	void handleClose();
+	void openView();
+	void populateTerritoriesMenu();
+	bool passesFilters(const TrainInfo &train) const;
+	int sortedIndex(const TrainInfo &train, int oldIndex) const;
+	void insertRow(TrainInfo &train, int index);
+	void removeRow(const TrainInfo &train);
+	void showTrain(TrainInfo &train, bool added, const ColumnSet &columnsChanged, bool historyChanged);
+	const wchar_t *cellText(TrainInfo &train, size_t column);
+	void setHistoryShown(bool shown);
+	LRESULT customDrawTrains(const NMLVCUSTOMDRAW &info);
+	void drawHistory(HDC dc, const RECT &rect, const TrainInfo &train, bool selected);
+	void refilter();
+	void updateFilter();
+	void reloadLocationDatabase();
 	static ListViewCompareCallback rawCompareCallback;
 	static int compareTrains(const TrainInfo &x, const TrainInfo &y, unsigned int column, int sortOrder);
-	winrt::Windows::Foundation::IAsyncAction receiveMessages();
 	void updateLayoutAndFont();
 	void updateLayout();
 	void updateColumnHeaderArrows();
 	void updateDateTimeMenuItems();
+	void updateHistoryMenuItems();
+	void updateStatus();
 };
 }
 
@@ -5,6 +5,7 @@
 #define IDS_APP_NAME                    0
 #define IDS_UNKNOWN_ERROR               1
 #define IDS_CANCEL                      2
+#define IDS_LOCATION_DATABASE_ERROR     3
 #define IDS_ERROR                       104
 #define IDR_MAIN_MENU                   112
 #define IDB_DRIVER_ICONS                113
@@ -15,6 +16,7 @@
 #define IDS_WELCOME_NO_PERMISSION       204
 #define IDS_WELCOME_CONNECTION_ERROR    205
 #define IDS_ERROR_NO_PERMISSION         300
+#define IDS_ERROR_INVALID_LOCATION_DATABASE 301
 #define IDS_MAIN_PERMISSION_RESCINDED   400
 #define IDS_MAIN_CONNECTION_ERROR       401
 #define IDS_MAIN_TIME_FRAME             402
@@ -27,15 +29,20 @@
 #define IDS_MAIN_COLUMN_TERRITORY       409
 #define IDS_MAIN_COLUMN_LOCATION        410
 #define IDS_MAIN_COLUMN_CREW            411
-#define IDS_TERRITORY_BAKERSFIELD       800
-#define IDS_TERRITORY_MOJAVE            801
-#define IDS_TERRITORY_BARSTOW           802
-#define IDS_TERRITORY_NEEDLES           803
-#define IDS_TERRITORY_SELIGMAN          804
-#define IDS_TERRITORY_CAJON             805
-#define IDS_TERRITORY_SBD               806
-#define IDS_TERRITORY_ALHAMBRA          807
-#define IDS_TERRITORY_ROSEVILLE         807
+#define IDS_MAIN_RECONNECTING           412
+#define IDS_MAIN_COLUMN_SERVER          413
+#define IDS_MAIN_STATUS                 414
+#define IDS_MAIN_FILTER                 415
+#define IDS_MAIN_FILTER_CUE             416
+#define IDS_MAIN_FILTER_ERROR_TITLE     417
+#define IDS_MAIN_FILTER_ERROR           418
+#define IDS_MAIN_COLUMN_HISTORY         419
+#define IDS_MAIN_COLUMN_NEXT_LOCATION   420
+#define IDS_MAIN_COLUMN_ETA             421
+#define IDS_DIAGNOSTICS_TITLE           500
+#define IDS_DIAGNOSTICS_RESET           501
+#define IDS_DIAGNOSTICS_SAVE            502
+#define IDS_DIAGNOSTICS_SAVED           503
 #define IDI_TRAINLIST8                  900
 #define ID_FILE_EXIT                    40001
 #define ID_MAIN_MENU_FILE_EXIT          40002
@@ -44,6 +51,14 @@
 #define ID_MAIN_MENU_VIEW_TERRITORIES_UNKNOWN 40005
 #define ID_MAIN_MENU_VIEW_DATE_LOCALE   40006
 #define ID_MAIN_MENU_VIEW_DATE_ISO8601  40007
+#define ID_MAIN_MENU_VIEW_DIAGNOSTICS   40008
+#define ID_MAIN_MENU_FILE_RELOAD_LOCATIONS 40009
+#define ID_MAIN_MENU_VIEW_NEW_WINDOW    40010
+#define ID_MAIN_MENU_VIEW_HISTORY       40011
+#define ID_MAIN_MENU_VIEW_HISTORY_MEMORY_OFF 40012
+#define ID_MAIN_MENU_VIEW_HISTORY_MEMORY_256K 40013
+#define ID_MAIN_MENU_VIEW_HISTORY_MEMORY_1M 40014
+#define ID_MAIN_MENU_VIEW_HISTORY_MEMORY_4M 40015
 
 // Next default values for new objects
 // 
@@ -51,7 +66,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NO_MFC                     1
 #define _APS_NEXT_RESOURCE_VALUE        116
-#define _APS_NEXT_COMMAND_VALUE         40008
+#define _APS_NEXT_COMMAND_VALUE         40016
 #define _APS_NEXT_CONTROL_VALUE         1001
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
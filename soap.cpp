@@ -1,9 +1,12 @@
 #include "pch.h"
 #include <array>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <limits>
 #include <type_traits>
 #include "soap.h"
+#include "utf8.h"
 #include "util.h"
 
 namespace soap = trainlist8::soap;
@@ -27,6 +30,21 @@ constinit const WS_XML_STRING tempURI = u8"http://tempuri.org/"_as_xml;
 // The http://schemas.datacontract.org/2004/07/DispatcherComms.MessagesFromRun8 URL.
 constinit const WS_XML_STRING messagesFromRun8 = u8"http://schemas.datacontract.org/2004/07/DispatcherComms.MessagesFromRun8"_as_xml;
 
+// The http://schemas.datacontract.org/2004/07/DispatcherComms.MessagesFromDispatcher URL.
+constinit const WS_XML_STRING messagesFromDispatcher = u8"http://schemas.datacontract.org/2004/07/DispatcherComms.MessagesFromDispatcher"_as_xml;
+
+// The http://schemas.microsoft.com/2003/10/Serialization/Arrays URL.
+constinit const WS_XML_STRING serializationArrays = u8"http://schemas.microsoft.com/2003/10/Serialization/Arrays"_as_xml;
+
+// The int XML element, used for each item in an array of integers.
+constinit const WS_XML_STRING intItemName = u8"int"_as_xml;
+
+// The Route XML element name, used by the track state messages.
+constinit const WS_XML_STRING routeFieldName = u8"Route"_as_xml;
+
+// The number of times startSession has been called, which tells caches keyed by binary XML dictionary string IDs when the IDs they hold might belong to a session that has ended.
+std::atomic<uint32_t> sessionEpoch;
+
 // A struct field that matches and discards any single element.
 constinit const WS_FIELD_DESCRIPTION discardedElementField = {
 	.mapping = WS_ANY_ELEMENT_FIELD_MAPPING,
@@ -348,18 +366,83 @@ constinit const WS_ELEMENT_DESCRIPTION rootElement = {
 //		<b:Route>250</b:Route>
 //	</pMessage>
 // </SetOccupiedBlocks>
-//
-// In this application, the body is ignored.
 namespace setOccupiedBlocks {
-constinit const WS_XML_STRING rootName = u8"SetOccupiedBlocks"_as_xml;
+// Sanity checks on the C++-side structure.
+static_assert(std::is_standard_layout_v<OccupiedBlocks>);
+static_assert(std::is_trivial_v<OccupiedBlocks>);
+
+// The OccupiedBlocks XML element.
+constinit const WS_XML_STRING occupiedBlocksFieldName = u8"OccupiedBlocks"_as_xml;
+constinit const WS_FIELD_DESCRIPTION occupiedBlocksFieldDescription = {
+	.mapping = WS_REPEATING_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&occupiedBlocksFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
+	.type = WS_INT32_TYPE,
+	.offset = offsetof(OccupiedBlocks, occupiedBlocks),
+	.countOffset = offsetof(OccupiedBlocks, occupiedBlockCount),
+	.itemLocalName = const_cast<WS_XML_STRING *>(&common::intItemName),
+	.itemNs = const_cast<WS_XML_STRING *>(&common::serializationArrays),
+};
 
-constinit const WS_XML_STRING action = u8"http://tempuri.org/IWCFRun8/SetOccupiedBlocks"_as_xml;
+// The OpenManualSwitchBlocks XML element.
+constinit const WS_XML_STRING openManualSwitchBlocksFieldName = u8"OpenManualSwitchBlocks"_as_xml;
+constinit const WS_FIELD_DESCRIPTION openManualSwitchBlocksFieldDescription = {
+	.mapping = WS_REPEATING_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&openManualSwitchBlocksFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
+	.type = WS_INT32_TYPE,
+	.offset = offsetof(OccupiedBlocks, openManualSwitchBlocks),
+	.countOffset = offsetof(OccupiedBlocks, openManualSwitchBlockCount),
+	.itemLocalName = const_cast<WS_XML_STRING *>(&common::intItemName),
+	.itemNs = const_cast<WS_XML_STRING *>(&common::serializationArrays),
+};
+
+// The Route XML element.
+constinit const WS_FIELD_DESCRIPTION routeFieldDescription = {
+	.mapping = WS_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&common::routeFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
+	.type = WS_INT32_TYPE,
+	.offset = offsetof(OccupiedBlocks, route),
+};
+
+// The pMessage XML element.
+constinit const std::array pMessageFieldDescriptions = {
+	const_cast<WS_FIELD_DESCRIPTION *>(&occupiedBlocksFieldDescription),
+	const_cast<WS_FIELD_DESCRIPTION *>(&openManualSwitchBlocksFieldDescription),
+	const_cast<WS_FIELD_DESCRIPTION *>(&routeFieldDescription),
+};
+constinit const WS_STRUCT_DESCRIPTION pMessageStructDescription = {
+	.size = sizeof(OccupiedBlocks),
+	.alignment = alignof(OccupiedBlocks),
+	.fields = const_cast<WS_FIELD_DESCRIPTION **>(pMessageFieldDescriptions.data()),
+	.fieldCount = pMessageFieldDescriptions.size(),
+};
+constinit const WS_FIELD_DESCRIPTION pMessageFieldDescription = {
+	.mapping = WS_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&common::pMessageFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::tempURI),
+	.type = WS_STRUCT_TYPE,
+	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&pMessageStructDescription),
+};
 
+// The root SetOccupiedBlocks XML element.
+constinit const std::array rootFieldDescriptions = {
+	const_cast<WS_FIELD_DESCRIPTION *>(&pMessageFieldDescription),
+};
+constinit const WS_XML_STRING rootName = u8"SetOccupiedBlocks"_as_xml;
+constinit const WS_XML_STRING action = u8"http://tempuri.org/IWCFRun8/SetOccupiedBlocks"_as_xml;
+constinit const WS_STRUCT_DESCRIPTION rootStructDescription = {
+	.size = sizeof(OccupiedBlocks),
+	.alignment = alignof(OccupiedBlocks),
+	.fields = const_cast<WS_FIELD_DESCRIPTION **>(rootFieldDescriptions.data()),
+	.fieldCount = rootFieldDescriptions.size(),
+};
 constinit const WS_ELEMENT_DESCRIPTION rootElement = {
 	.elementLocalName = const_cast<WS_XML_STRING *>(&rootName),
 	.elementNs = const_cast<WS_XML_STRING *>(&common::tempURI),
 	.type = WS_STRUCT_TYPE,
-	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&common::discardedStruct),
+	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&rootStructDescription),
 };
 }
 
@@ -378,18 +461,69 @@ constinit const WS_ELEMENT_DESCRIPTION rootElement = {
 //		<b:Route>250</b:Route>
 //	</pMessage>
 // </SetOccupiedSwitches>
-//
-// In this application, the body is ignored.
 namespace setOccupiedSwitches {
-constinit const WS_XML_STRING rootName = u8"SetOccupiedSwitches"_as_xml;
+// Sanity checks on the C++-side structure.
+static_assert(std::is_standard_layout_v<SwitchList>);
+static_assert(std::is_trivial_v<SwitchList>);
+
+// The OccupiedSwitches XML element.
+constinit const WS_XML_STRING occupiedSwitchesFieldName = u8"OccupiedSwitches"_as_xml;
+constinit const WS_FIELD_DESCRIPTION occupiedSwitchesFieldDescription = {
+	.mapping = WS_REPEATING_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&occupiedSwitchesFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
+	.type = WS_INT32_TYPE,
+	.offset = offsetof(SwitchList, switches),
+	.countOffset = offsetof(SwitchList, switchCount),
+	.itemLocalName = const_cast<WS_XML_STRING *>(&common::intItemName),
+	.itemNs = const_cast<WS_XML_STRING *>(&common::serializationArrays),
+};
 
-constinit const WS_XML_STRING action = u8"http://tempuri.org/IWCFRun8/SetOccupiedSwitches"_as_xml;
+// The Route XML element.
+constinit const WS_FIELD_DESCRIPTION routeFieldDescription = {
+	.mapping = WS_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&common::routeFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
+	.type = WS_INT32_TYPE,
+	.offset = offsetof(SwitchList, route),
+};
+
+// The pMessage XML element.
+constinit const std::array pMessageFieldDescriptions = {
+	const_cast<WS_FIELD_DESCRIPTION *>(&occupiedSwitchesFieldDescription),
+	const_cast<WS_FIELD_DESCRIPTION *>(&routeFieldDescription),
+};
+constinit const WS_STRUCT_DESCRIPTION pMessageStructDescription = {
+	.size = sizeof(SwitchList),
+	.alignment = alignof(SwitchList),
+	.fields = const_cast<WS_FIELD_DESCRIPTION **>(pMessageFieldDescriptions.data()),
+	.fieldCount = pMessageFieldDescriptions.size(),
+};
+constinit const WS_FIELD_DESCRIPTION pMessageFieldDescription = {
+	.mapping = WS_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&common::pMessageFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::tempURI),
+	.type = WS_STRUCT_TYPE,
+	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&pMessageStructDescription),
+};
 
+// The root SetOccupiedSwitches XML element.
+constinit const std::array rootFieldDescriptions = {
+	const_cast<WS_FIELD_DESCRIPTION *>(&pMessageFieldDescription),
+};
+constinit const WS_XML_STRING rootName = u8"SetOccupiedSwitches"_as_xml;
+constinit const WS_XML_STRING action = u8"http://tempuri.org/IWCFRun8/SetOccupiedSwitches"_as_xml;
+constinit const WS_STRUCT_DESCRIPTION rootStructDescription = {
+	.size = sizeof(SwitchList),
+	.alignment = alignof(SwitchList),
+	.fields = const_cast<WS_FIELD_DESCRIPTION **>(rootFieldDescriptions.data()),
+	.fieldCount = rootFieldDescriptions.size(),
+};
 constinit const WS_ELEMENT_DESCRIPTION rootElement = {
 	.elementLocalName = const_cast<WS_XML_STRING *>(&rootName),
 	.elementNs = const_cast<WS_XML_STRING *>(&common::tempURI),
 	.type = WS_STRUCT_TYPE,
-	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&common::discardedStruct),
+	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&rootStructDescription),
 };
 }
 
@@ -404,18 +538,65 @@ constinit const WS_ELEMENT_DESCRIPTION rootElement = {
 //		<b:Route>100</b:Route>
 //	</pMessage>
 // </SetReversedSwitches>
-//
-// In this application, the body is ignored.
 namespace setReversedSwitches {
-constinit const WS_XML_STRING rootName = u8"SetReversedSwitches"_as_xml;
+// The ReversedSwitches XML element.
+constinit const WS_XML_STRING reversedSwitchesFieldName = u8"ReversedSwitches"_as_xml;
+constinit const WS_FIELD_DESCRIPTION reversedSwitchesFieldDescription = {
+	.mapping = WS_REPEATING_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&reversedSwitchesFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
+	.type = WS_INT32_TYPE,
+	.offset = offsetof(SwitchList, switches),
+	.countOffset = offsetof(SwitchList, switchCount),
+	.itemLocalName = const_cast<WS_XML_STRING *>(&common::intItemName),
+	.itemNs = const_cast<WS_XML_STRING *>(&common::serializationArrays),
+};
 
-constinit const WS_XML_STRING action = u8"http://tempuri.org/IWCFRun8/SetReversedSwitches"_as_xml;
+// The Route XML element.
+constinit const WS_FIELD_DESCRIPTION routeFieldDescription = {
+	.mapping = WS_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&common::routeFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
+	.type = WS_INT32_TYPE,
+	.offset = offsetof(SwitchList, route),
+};
+
+// The pMessage XML element.
+constinit const std::array pMessageFieldDescriptions = {
+	const_cast<WS_FIELD_DESCRIPTION *>(&reversedSwitchesFieldDescription),
+	const_cast<WS_FIELD_DESCRIPTION *>(&routeFieldDescription),
+};
+constinit const WS_STRUCT_DESCRIPTION pMessageStructDescription = {
+	.size = sizeof(SwitchList),
+	.alignment = alignof(SwitchList),
+	.fields = const_cast<WS_FIELD_DESCRIPTION **>(pMessageFieldDescriptions.data()),
+	.fieldCount = pMessageFieldDescriptions.size(),
+};
+constinit const WS_FIELD_DESCRIPTION pMessageFieldDescription = {
+	.mapping = WS_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&common::pMessageFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::tempURI),
+	.type = WS_STRUCT_TYPE,
+	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&pMessageStructDescription),
+};
 
+// The root SetReversedSwitches XML element.
+constinit const std::array rootFieldDescriptions = {
+	const_cast<WS_FIELD_DESCRIPTION *>(&pMessageFieldDescription),
+};
+constinit const WS_XML_STRING rootName = u8"SetReversedSwitches"_as_xml;
+constinit const WS_XML_STRING action = u8"http://tempuri.org/IWCFRun8/SetReversedSwitches"_as_xml;
+constinit const WS_STRUCT_DESCRIPTION rootStructDescription = {
+	.size = sizeof(SwitchList),
+	.alignment = alignof(SwitchList),
+	.fields = const_cast<WS_FIELD_DESCRIPTION **>(rootFieldDescriptions.data()),
+	.fieldCount = rootFieldDescriptions.size(),
+};
 constinit const WS_ELEMENT_DESCRIPTION rootElement = {
 	.elementLocalName = const_cast<WS_XML_STRING *>(&rootName),
 	.elementNs = const_cast<WS_XML_STRING *>(&common::tempURI),
 	.type = WS_STRUCT_TYPE,
-	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&common::discardedStruct),
+	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&rootStructDescription),
 };
 }
 
@@ -436,18 +617,70 @@ constinit const WS_ELEMENT_DESCRIPTION rootElement = {
 //		</b:Signals>
 //	</pMessage>
 // </SetSignals>
-//
-// In this application, the body is ignored.
 namespace setSignals {
-constinit const WS_XML_STRING rootName = u8"SetSignals"_as_xml;
+// Sanity checks on the C++-side structure.
+static_assert(std::is_standard_layout_v<Signals>);
+static_assert(std::is_trivial_v<Signals>);
 
-constinit const WS_XML_STRING action = u8"http://tempuri.org/IWCFRun8/SetSignals"_as_xml;
+// The Route XML element.
+constinit const WS_FIELD_DESCRIPTION routeFieldDescription = {
+	.mapping = WS_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&common::routeFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
+	.type = WS_INT32_TYPE,
+	.offset = offsetof(Signals, route),
+};
+
+// The Signals XML element.
+constinit const WS_XML_STRING signalsFieldName = u8"Signals"_as_xml;
+constinit const WS_XML_STRING signalIndicationItemName = u8"ESignalIndication"_as_xml;
+constinit const WS_FIELD_DESCRIPTION signalsFieldDescription = {
+	.mapping = WS_REPEATING_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&signalsFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
+	.type = WS_XML_STRING_TYPE,
+	.offset = offsetof(Signals, indications),
+	.countOffset = offsetof(Signals, indicationCount),
+	.itemLocalName = const_cast<WS_XML_STRING *>(&signalIndicationItemName),
+	.itemNs = const_cast<WS_XML_STRING *>(&common::messagesFromDispatcher),
+};
+
+// The pMessage XML element.
+constinit const std::array pMessageFieldDescriptions = {
+	const_cast<WS_FIELD_DESCRIPTION *>(&routeFieldDescription),
+	const_cast<WS_FIELD_DESCRIPTION *>(&signalsFieldDescription),
+};
+constinit const WS_STRUCT_DESCRIPTION pMessageStructDescription = {
+	.size = sizeof(Signals),
+	.alignment = alignof(Signals),
+	.fields = const_cast<WS_FIELD_DESCRIPTION **>(pMessageFieldDescriptions.data()),
+	.fieldCount = pMessageFieldDescriptions.size(),
+};
+constinit const WS_FIELD_DESCRIPTION pMessageFieldDescription = {
+	.mapping = WS_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&common::pMessageFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::tempURI),
+	.type = WS_STRUCT_TYPE,
+	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&pMessageStructDescription),
+};
 
+// The root SetSignals XML element.
+constinit const std::array rootFieldDescriptions = {
+	const_cast<WS_FIELD_DESCRIPTION *>(&pMessageFieldDescription),
+};
+constinit const WS_XML_STRING rootName = u8"SetSignals"_as_xml;
+constinit const WS_XML_STRING action = u8"http://tempuri.org/IWCFRun8/SetSignals"_as_xml;
+constinit const WS_STRUCT_DESCRIPTION rootStructDescription = {
+	.size = sizeof(Signals),
+	.alignment = alignof(Signals),
+	.fields = const_cast<WS_FIELD_DESCRIPTION **>(rootFieldDescriptions.data()),
+	.fieldCount = rootFieldDescriptions.size(),
+};
 constinit const WS_ELEMENT_DESCRIPTION rootElement = {
 	.elementLocalName = const_cast<WS_XML_STRING *>(&rootName),
 	.elementNs = const_cast<WS_XML_STRING *>(&common::tempURI),
 	.type = WS_STRUCT_TYPE,
-	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&common::discardedStruct),
+	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&rootStructDescription),
 };
 }
 
@@ -465,18 +698,65 @@ constinit const WS_ELEMENT_DESCRIPTION rootElement = {
 //		</b:UnlockedSwitches>
 //	</pMessage>
 // </SetUnlockedSwitches>
-//
-// In this application, the body is ignored.
 namespace setUnlockedSwitches {
-constinit const WS_XML_STRING rootName = u8"SetUnlockedSwitches"_as_xml;
+// The Route XML element.
+constinit const WS_FIELD_DESCRIPTION routeFieldDescription = {
+	.mapping = WS_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&common::routeFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
+	.type = WS_INT32_TYPE,
+	.offset = offsetof(SwitchList, route),
+};
 
-constinit const WS_XML_STRING action = u8"http://tempuri.org/IWCFRun8/SetUnlockedSwitches"_as_xml;
+// The UnlockedSwitches XML element.
+constinit const WS_XML_STRING unlockedSwitchesFieldName = u8"UnlockedSwitches"_as_xml;
+constinit const WS_FIELD_DESCRIPTION unlockedSwitchesFieldDescription = {
+	.mapping = WS_REPEATING_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&unlockedSwitchesFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
+	.type = WS_INT32_TYPE,
+	.offset = offsetof(SwitchList, switches),
+	.countOffset = offsetof(SwitchList, switchCount),
+	.itemLocalName = const_cast<WS_XML_STRING *>(&common::intItemName),
+	.itemNs = const_cast<WS_XML_STRING *>(&common::serializationArrays),
+};
+
+// The pMessage XML element.
+constinit const std::array pMessageFieldDescriptions = {
+	const_cast<WS_FIELD_DESCRIPTION *>(&routeFieldDescription),
+	const_cast<WS_FIELD_DESCRIPTION *>(&unlockedSwitchesFieldDescription),
+};
+constinit const WS_STRUCT_DESCRIPTION pMessageStructDescription = {
+	.size = sizeof(SwitchList),
+	.alignment = alignof(SwitchList),
+	.fields = const_cast<WS_FIELD_DESCRIPTION **>(pMessageFieldDescriptions.data()),
+	.fieldCount = pMessageFieldDescriptions.size(),
+};
+constinit const WS_FIELD_DESCRIPTION pMessageFieldDescription = {
+	.mapping = WS_ELEMENT_FIELD_MAPPING,
+	.localName = const_cast<WS_XML_STRING *>(&common::pMessageFieldName),
+	.ns = const_cast<WS_XML_STRING *>(&common::tempURI),
+	.type = WS_STRUCT_TYPE,
+	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&pMessageStructDescription),
+};
 
+// The root SetUnlockedSwitches XML element.
+constinit const std::array rootFieldDescriptions = {
+	const_cast<WS_FIELD_DESCRIPTION *>(&pMessageFieldDescription),
+};
+constinit const WS_XML_STRING rootName = u8"SetUnlockedSwitches"_as_xml;
+constinit const WS_XML_STRING action = u8"http://tempuri.org/IWCFRun8/SetUnlockedSwitches"_as_xml;
+constinit const WS_STRUCT_DESCRIPTION rootStructDescription = {
+	.size = sizeof(SwitchList),
+	.alignment = alignof(SwitchList),
+	.fields = const_cast<WS_FIELD_DESCRIPTION **>(rootFieldDescriptions.data()),
+	.fieldCount = rootFieldDescriptions.size(),
+};
 constinit const WS_ELEMENT_DESCRIPTION rootElement = {
 	.elementLocalName = const_cast<WS_XML_STRING *>(&rootName),
 	.elementNs = const_cast<WS_XML_STRING *>(&common::tempURI),
 	.type = WS_STRUCT_TYPE,
-	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&common::discardedStruct),
+	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&rootStructDescription),
 };
 }
 
@@ -703,29 +983,250 @@ constinit const WS_FIELD_DESCRIPTION trainWeightTonsFieldDescription = {
 };
 
 // The Train XML element.
+//
+// Rather than letting WWSAPI match each child element against the fields one after another, this element is read by readTrain, which looks each child up by name in a perfect hash table of the fields. The children can therefore arrive in any order, and any it does not recognize, such as fields added by later versions of Run 8, are skipped instead of failing the whole message.
 constinit const WS_XML_STRING trainFieldName = u8"Train"_as_xml;
-constinit const std::array trainStructFieldDescriptions = {
-	const_cast<WS_FIELD_DESCRIPTION *>(&axleCountFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&blockIDFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&engineerNameFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&engineerTypeFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&holdingForDispatcherFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&hpPerTonFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&locoNumberFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&railroadInitialsFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&relinquishWhenStoppedFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&trainIDFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&trainLengthFeetFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&trainSpeedLimitMPHFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&trainSpeedMPHFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&trainSymbolFieldDescription),
-	const_cast<WS_FIELD_DESCRIPTION *>(&trainWeightTonsFieldDescription),
-};
-constinit const WS_STRUCT_DESCRIPTION trainStructDescription = {
+constinit const std::array trainFields = {
+	&axleCountFieldDescription,
+	&blockIDFieldDescription,
+	&engineerNameFieldDescription,
+	&engineerTypeFieldDescription,
+	&holdingForDispatcherFieldDescription,
+	&hpPerTonFieldDescription,
+	&locoNumberFieldDescription,
+	&railroadInitialsFieldDescription,
+	&relinquishWhenStoppedFieldDescription,
+	&trainIDFieldDescription,
+	&trainLengthFeetFieldDescription,
+	&trainSpeedLimitMPHFieldDescription,
+	&trainSpeedMPHFieldDescription,
+	&trainSymbolFieldDescription,
+	&trainWeightTonsFieldDescription,
+};
+
+// The number of buckets in the Train field table, a power of two comfortably above the number of fields so that a seed that separates them all is found quickly.
+constexpr size_t trainFieldBuckets = 32;
+
+// Hashes an XML string using FNV-1a, starting from a seed.
+uint32_t hashXMLString(const WS_XML_STRING &string, uint32_t seed) {
+	uint32_t hash = 2166136261U ^ seed;
+	for(unsigned long i = 0; i != string.length; ++i) {
+		hash = (hash ^ string.bytes[i]) * 16777619U;
+	}
+	return hash;
+}
+
+// A perfect hash table of the Train fields, keyed by local name.
+struct TrainFieldTable final {
+	// The seed for which every field hashes to a different bucket.
+	uint32_t seed;
+
+	// The field in each bucket, or null for an empty bucket.
+	std::array<const WS_FIELD_DESCRIPTION *, trainFieldBuckets> buckets;
+
+	// Returns the field with a given local name and namespace, or null if there is none.
+	const WS_FIELD_DESCRIPTION *find(const WS_XML_STRING &localName, const WS_XML_STRING &ns) const {
+		const WS_FIELD_DESCRIPTION *field = buckets[hashXMLString(localName, seed) % trainFieldBuckets];
+		if(field && WsXmlStringEquals(&localName, field->localName, nullptr) == S_OK && WsXmlStringEquals(&ns, field->ns, nullptr) == S_OK) {
+			return field;
+		} else {
+			return nullptr;
+		}
+	}
+};
+
+// Builds the Train field table, trying seeds in turn until one gives every field a bucket of its own.
+TrainFieldTable buildTrainFieldTable() {
+	for(uint32_t seed = 0;; ++seed) {
+		TrainFieldTable table = {.seed = seed, .buckets = {}};
+		bool collided = false;
+		for(const WS_FIELD_DESCRIPTION *i : trainFields) {
+			const WS_FIELD_DESCRIPTION *&bucket = table.buckets[hashXMLString(*i->localName, seed) % trainFieldBuckets];
+			collided = collided || bucket;
+			bucket = i;
+		}
+		if(!collided) {
+			return table;
+		}
+	}
+}
+
+// Returns the number of bytes a Train field occupies in TrainData.
+ULONG trainFieldSize(const WS_FIELD_DESCRIPTION &field) {
+	switch(field.type) {
+		case WS_BOOL_TYPE:
+			return sizeof(BOOL);
+		case WS_ENUM_TYPE:
+			return sizeof(int);
+		case WS_FLOAT_TYPE:
+			return sizeof(float);
+		case WS_INT32_TYPE:
+			return sizeof(int32_t);
+		case WS_UINT32_TYPE:
+			return sizeof(uint32_t);
+		default:
+			throw winrt::hresult_invalid_argument();
+	}
+}
+
+// Transcodes the UTF-8 text of a string element into a nul-terminated wide string allocated on the heap.
+//
+// String fields are read as UTF-8 and transcoded here rather than by WWSAPI, so that the usual all-ASCII value goes through utf8::widenASCII and only anything after the first non-ASCII byte needs MultiByteToWideChar.
+const wchar_t *widenString(const WS_XML_STRING &text, WS_HEAP *heap, WS_ERROR *error) {
+	// UTF-8 never takes fewer bytes than UTF-16 takes code units, so one code unit per byte plus the terminator is always enough.
+	void *buffer;
+	winrt::check_hresult(WsAlloc(heap, (static_cast<size_t>(text.length) + 1) * sizeof(wchar_t), &buffer, error));
+	wchar_t *wide = static_cast<wchar_t *>(buffer);
+	size_t length = utf8::widenASCII(text.bytes, text.length, wide);
+	if(length != text.length) {
+		int rest = static_cast<int>(text.length - length);
+		int written = MultiByteToWideChar(CP_UTF8, 0, reinterpret_cast<const char *>(text.bytes + length), rest, wide + length, rest);
+		if(!written) {
+			winrt::throw_last_error();
+		}
+		length += written;
+	}
+	wide[length] = L'\0';
+	return wide;
+}
+
+// Hashes the value of one Train field with 64-bit FNV-1a, as part of the fingerprint of a whole Train element.
+//
+// The field's address is mixed in so that the same value in two different fields hashes differently. The fingerprint is the sum of its fields' hashes, so it does not depend on the order the fields arrive in.
+uint64_t hashTrainField(const WS_FIELD_DESCRIPTION &field, const void *data, size_t length) {
+	uint64_t hash = 14695981039346656037ULL ^ reinterpret_cast<uintptr_t>(&field);
+	for(size_t i = 0; i != length; ++i) {
+		hash = (hash ^ static_cast<const unsigned char *>(data)[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+// The number of entries in each thread's cache of Train field names.
+constexpr size_t trainFieldCacheSize = 64;
+
+// A Train field name, as identified by the binary XML dictionary strings of its local name and namespace, and the field it resolved to.
+struct TrainFieldCacheEntry final {
+	// The dictionary holding the local name, or null for an empty entry.
+	const WS_XML_DICTIONARY *nameDictionary;
+
+	// The ID of the local name within its dictionary.
+	ULONG nameID;
+
+	// The dictionary holding the namespace.
+	const WS_XML_DICTIONARY *nsDictionary;
+
+	// The ID of the namespace within its dictionary.
+	ULONG nsID;
+
+	// The field, or null if the name is not that of any field.
+	const WS_FIELD_DESCRIPTION *field;
+};
+
+// A direct-mapped cache of resolved Train field names, indexed by local name ID.
+struct TrainFieldCache final {
+	// The session epoch the entries were resolved in.
+	uint32_t epoch;
+
+	// The entries.
+	std::array<TrainFieldCacheEntry, trainFieldCacheSize> entries;
+};
+
+// Each thread's cache of resolved Train field names.
+//
+// Each thread has its own so that connections decoding on different threads do not contend. Within a session, a dictionary ID always stands for the same string, so once a name has been resolved, later messages find it by ID alone, without hashing or comparing its bytes.
+thread_local TrainFieldCache trainFieldCache;
+
+// Returns the Train field that an element stands for, or null if it is not one.
+//
+// Names sent as binary XML dictionary strings, which is how a net.tcp session sends each name after its first use, are resolved through the cache; anything else goes straight to the table.
+const WS_FIELD_DESCRIPTION *findTrainField(const TrainFieldTable &table, const WS_XML_ELEMENT_NODE &element) {
+	const WS_XML_STRING &name = *element.localName, &ns = *element.ns;
+	if(!name.dictionary || !ns.dictionary) {
+		return table.find(name, ns);
+	}
+	uint32_t epoch = common::sessionEpoch.load(std::memory_order_acquire);
+	if(trainFieldCache.epoch != epoch) {
+		trainFieldCache.epoch = epoch;
+		trainFieldCache.entries = {};
+	}
+	TrainFieldCacheEntry &entry = trainFieldCache.entries[name.id % trainFieldCacheSize];
+	if(entry.nameDictionary != name.dictionary || entry.nameID != name.id || entry.nsDictionary != ns.dictionary || entry.nsID != ns.id) {
+		entry = {
+			.nameDictionary = name.dictionary,
+			.nameID = name.id,
+			.nsDictionary = ns.dictionary,
+			.nsID = ns.id,
+			.field = table.find(name, ns),
+		};
+	}
+	return entry.field;
+}
+
+// Reads the Train element into a TrainData.
+//
+// A field that is absent is left zero, or empty for a string, except that the train ID is required. The fingerprint is computed from the field values as they are read, with strings hashed as the UTF-8 that arrived rather than after widening.
+HRESULT WINAPI readTrain(WS_XML_READER *reader, WS_TYPE_MAPPING typeMapping, const void *, WS_HEAP *heap, void *value, ULONG valueSize, WS_ERROR *error) {
+	static const TrainFieldTable table = buildTrainFieldTable();
+	if(valueSize != sizeof(TrainData) || (typeMapping != WS_ELEMENT_TYPE_MAPPING && typeMapping != WS_ELEMENT_CONTENT_TYPE_MAPPING)) {
+		return E_INVALIDARG;
+	}
+	try {
+		TrainData &train = *static_cast<TrainData *>(value);
+		train = TrainData{};
+		if(typeMapping == WS_ELEMENT_TYPE_MAPPING) {
+			winrt::check_hresult(WsReadToStartElement(reader, nullptr, nullptr, nullptr, error));
+			winrt::check_hresult(WsReadStartElement(reader, error));
+		}
+		bool sawID = false;
+		for(;;) {
+			BOOL found;
+			winrt::check_hresult(WsReadToStartElement(reader, nullptr, nullptr, &found, error));
+			if(!found) {
+				break;
+			}
+			const WS_XML_NODE *node;
+			winrt::check_hresult(WsGetReaderNode(reader, &node, error));
+			const WS_XML_ELEMENT_NODE &element = *reinterpret_cast<const WS_XML_ELEMENT_NODE *>(node);
+			const WS_FIELD_DESCRIPTION *field = findTrainField(table, element);
+			if(!field) {
+				winrt::check_hresult(WsSkipNode(reader, error));
+				continue;
+			}
+			winrt::check_hresult(WsReadStartElement(reader, error));
+			std::byte *dest = static_cast<std::byte *>(value) + field->offset;
+			if(field->type == WS_WSZ_TYPE) {
+				WS_XML_STRING text;
+				winrt::check_hresult(WsReadType(reader, WS_ELEMENT_CONTENT_TYPE_MAPPING, WS_XML_STRING_TYPE, nullptr, WS_READ_REQUIRED_VALUE, heap, &text, sizeof(text), error));
+				*reinterpret_cast<const wchar_t **>(dest) = widenString(text, heap, error);
+				train.fingerprint += hashTrainField(*field, text.bytes, text.length);
+			} else {
+				ULONG size = trainFieldSize(*field);
+				winrt::check_hresult(WsReadType(reader, WS_ELEMENT_CONTENT_TYPE_MAPPING, field->type, field->typeDescription, WS_READ_REQUIRED_VALUE, heap, dest, size, error));
+				train.fingerprint += hashTrainField(*field, dest, size);
+			}
+			winrt::check_hresult(WsReadEndElement(reader, error));
+			sawID = sawID || field == &trainIDFieldDescription;
+		}
+		if(typeMapping == WS_ELEMENT_TYPE_MAPPING) {
+			winrt::check_hresult(WsReadEndElement(reader, error));
+		}
+		if(!sawID) {
+			return WS_E_INVALID_FORMAT;
+		}
+		for(const wchar_t **i : {&train.railroadInitials, &train.symbol, &train.engineerName}) {
+			if(!*i) {
+				*i = L"";
+			}
+		}
+		return S_OK;
+	} catch(...) {
+		return winrt::to_hresult();
+	}
+}
+constinit const WS_CUSTOM_TYPE_DESCRIPTION trainTypeDescription = {
 	.size = sizeof(TrainData),
 	.alignment = alignof(TrainData),
-	.fields = const_cast<WS_FIELD_DESCRIPTION **>(trainStructFieldDescriptions.data()),
-	.fieldCount = trainStructFieldDescriptions.size(),
+	.readCallback = &readTrain,
 };
 
 // The pMessage XML element.
@@ -733,8 +1234,8 @@ constinit const WS_FIELD_DESCRIPTION trainFieldDescription = {
 	.mapping = WS_ELEMENT_FIELD_MAPPING,
 	.localName = const_cast<WS_XML_STRING *>(&trainFieldName),
 	.ns = const_cast<WS_XML_STRING *>(&common::messagesFromRun8),
-	.type = WS_STRUCT_TYPE,
-	.typeDescription = const_cast<WS_STRUCT_DESCRIPTION *>(&trainStructDescription),
+	.type = WS_CUSTOM_TYPE,
+	.typeDescription = const_cast<WS_CUSTOM_TYPE_DESCRIPTION *>(&trainTypeDescription),
 };
 constinit const std::array pMessageStructFieldDescriptions = {
 	const_cast<WS_FIELD_DESCRIPTION *>(&trainFieldDescription),
@@ -833,4 +1334,11 @@ constinit const WS_MESSAGE_DESCRIPTION soap::setUnlockedSwitchesMessage = {
 constinit const WS_MESSAGE_DESCRIPTION soap::updateTrainDataMessage = {
 	.action = const_cast<WS_XML_STRING *>(&updateTrainData::action),
 	.bodyElementDescription = const_cast<WS_ELEMENT_DESCRIPTION *>(&updateTrainData::rootElement),
-};
\ No newline at end of file
+};
+
+// Notes that a new channel is about to be opened.
+//
+// The binary XML dictionary a channel builds up is freed along with the channel, so a new channel's dictionary may land at the same address as an old one. This makes sure nothing resolved against the old dictionary is taken to hold for the new one.
+void soap::startSession() {
+	common::sessionEpoch.fetch_add(1, std::memory_order_release);
+}
\ No newline at end of file
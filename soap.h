@@ -48,19 +48,63 @@ extern const WS_MESSAGE_DESCRIPTION sendSimulationStateMessage;
 // The SetInterlockErrorSwitches message, whose body is discarded.
 extern const WS_MESSAGE_DESCRIPTION setInterlockErrorSwitchesMessage;
 
-// The SetOccupiedBlocks message, whose body is discarded.
+// The body of a SetOccupiedBlocks message.
+struct OccupiedBlocks final {
+	// The blocks, numbered within the route, that are occupied by a train.
+	int32_t *occupiedBlocks;
+
+	// The number of elements in occupiedBlocks.
+	unsigned long occupiedBlockCount;
+
+	// The blocks, numbered within the route, that contain a hand-thrown switch that is not lined for the main track.
+	int32_t *openManualSwitchBlocks;
+
+	// The number of elements in openManualSwitchBlocks.
+	unsigned long openManualSwitchBlockCount;
+
+	// The route (territory) ID that the blocks belong to.
+	int32_t route;
+};
+
+// The SetOccupiedBlocks message, which has an OccupiedBlocks struct as its body.
 extern const WS_MESSAGE_DESCRIPTION setOccupiedBlocksMessage;
 
-// The SetOccupiedSwitches message, whose body is discarded.
+// The body of a SetOccupiedSwitches, SetReversedSwitches, or SetUnlockedSwitches message.
+struct SwitchList final {
+	// The switches, numbered within the route, that are in the state indicated by the message.
+	int32_t *switches;
+
+	// The number of elements in switches.
+	unsigned long switchCount;
+
+	// The route (territory) ID that the switches belong to.
+	int32_t route;
+};
+
+// The SetOccupiedSwitches message, which has a SwitchList struct as its body.
 extern const WS_MESSAGE_DESCRIPTION setOccupiedSwitchesMessage;
 
-// The SetReversedSwitches message, whose body is discarded.
+// The SetReversedSwitches message, which has a SwitchList struct as its body.
 extern const WS_MESSAGE_DESCRIPTION setReversedSwitchesMessage;
 
-// The SetSignals message, whose body is discarded.
+// The body of a SetSignals message.
+struct Signals final {
+	// The route (territory) ID that the signals belong to.
+	int32_t route;
+
+	// The names of the indications displayed by the signals, in signal number order.
+	//
+	// These are kept as strings, rather than decoded as an enumeration, so that an indication added in a future version of Run 8 does not cause the whole message to fail to decode.
+	WS_XML_STRING *indications;
+
+	// The number of elements in indications.
+	unsigned long indicationCount;
+};
+
+// The SetSignals message, which has a Signals struct as its body.
 extern const WS_MESSAGE_DESCRIPTION setSignalsMessage;
 
-// The SetUnlockedSwitches message, whose body is discarded.
+// The SetUnlockedSwitches message, which has a SwitchList struct as its body.
 extern const WS_MESSAGE_DESCRIPTION setUnlockedSwitchesMessage;
 
 // The possible engineer types.
@@ -124,10 +168,18 @@ struct TrainData final {
 
 	// Whether the AI engineer has been ordered to disembark when the train next stops.
 	BOOL relinquishWhenStopped;
+
+	// A hash of the values of all the other fields, which is not sent by Run 8 but computed while decoding.
+	//
+	// Two messages carrying the same values have the same fingerprint, so a message that repeats the previous one for the same train can be recognized without comparing its fields one by one.
+	uint64_t fingerprint;
 };
 
 // The UpdateTrainData message, which has a TrainData struct as its body.
 extern const WS_MESSAGE_DESCRIPTION updateTrainDataMessage;
+
+// Notes that a new channel is about to be opened, so that nothing cached from the binary XML session of an earlier channel is reused.
+void startSession();
 }
 }
 
@@ -0,0 +1,99 @@
+#include "pch.h"
+#include <algorithm>
+#include <iomanip>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "startup.h"
+
+namespace trainlist8 {
+namespace startup {
+namespace {
+// A phase of startup that has finished.
+struct Phase final {
+	// The name of the phase.
+	const char *name;
+
+	// How long after the process was created the phase finished, in 100-nanosecond ticks.
+	uint64_t elapsed;
+};
+
+// The phases recorded so far.
+//
+// This is only accessed from the UI thread.
+std::vector<Phase> phases;
+
+// Whether the log has been written.
+bool finished = false;
+
+// Converts a FILETIME to a count of 100-nanosecond ticks.
+uint64_t toTicks(const FILETIME &time) {
+	return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+}
+
+// Returns how long it has been since the process was created, in 100-nanosecond ticks.
+//
+// The process creation time is used as the origin, rather than the first call, so that loading the executable and its DLLs is counted too.
+uint64_t elapsedSinceCreation() {
+	FILETIME creation, exit, kernel, user, now;
+	if(!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		return 0;
+	}
+	GetSystemTimePreciseAsFileTime(&now);
+	uint64_t start = toTicks(creation), end = toTicks(now);
+	return end > start ? end - start : 0;
+}
+}
+}
+}
+
+// Records that a phase of startup has just finished, along with how long it has been since the process was created.
+//
+// Phases are only recorded until the log is written, so marking a phase costs nothing afterwards. This must only be called on the UI thread.
+void trainlist8::startup::mark(const char *phase) {
+	if(!finished) {
+		phases.push_back(Phase{.name = phase, .elapsed = elapsedSinceCreation()});
+	}
+}
+
+// Writes the phases recorded so far to trainlist8-startup.log in the temporary directory, replacing the log from the last run.
+//
+// Only the first call does anything. The log is only for diagnostics, so if it cannot be written, it is silently dropped rather than getting in the way of the user. This must only be called on the UI thread.
+void trainlist8::startup::finish() {
+	if(finished) {
+		return;
+	}
+	finished = true;
+
+	// Build the log.
+	std::string contents;
+	{
+		std::ostringstream oss;
+		oss.imbue(std::locale::classic());
+		oss << "Phase,Elapsed (ms),Duration (ms)\r\n" << std::fixed << std::setprecision(1);
+		uint64_t previous = 0;
+		for(const Phase &i : phases) {
+			oss << i.name << ',' << static_cast<double>(i.elapsed) / 10000.0 << ',' << static_cast<double>(i.elapsed - std::min(previous, i.elapsed)) / 10000.0 << "\r\n";
+			previous = i.elapsed;
+		}
+		contents = std::move(oss).str();
+	}
+	phases.clear();
+	phases.shrink_to_fit();
+
+	// Write it.
+	std::wstring path(MAX_PATH + 1, L'\0');
+	DWORD len = GetTempPathW(static_cast<DWORD>(path.size()), path.data());
+	if(!len) {
+		return;
+	}
+	path.resize(len);
+	path += L"trainlist8-startup.log";
+	winrt::file_handle file(CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+	if(!file) {
+		return;
+	}
+	DWORD written;
+	WriteFile(file.get(), contents.data(), static_cast<DWORD>(contents.size()), &written, nullptr);
+}
\ No newline at end of file
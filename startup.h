@@ -0,0 +1,13 @@
+#pragma once
+
+#if !defined(STARTUP_H)
+#define STARTUP_H
+
+namespace trainlist8 {
+namespace startup {
+void mark(const char *phase);
+void finish();
+}
+}
+
+#endif
\ No newline at end of file
@@ -1,81 +1,58 @@
 #include "pch.h"
-#include "territory.h"
-#include "resource.h"
-#include "util.h"
-#include <algorithm>
 #include <array>
+#include <bit>
+#include "territory.h"
+#include "database.h"
 
 namespace trainlist8::territory {
 namespace {
-// The known territory IDs and their associated string resource IDs.
-constexpr std::array<std::pair<unsigned int, unsigned int>, count> resourceIDs{{
-	{100, IDS_TERRITORY_MOJAVE},
-	{110, IDS_TERRITORY_NEEDLES},
-	{120, IDS_TERRITORY_CAJON},
-	{130, IDS_TERRITORY_SELIGMAN},
-	{150, IDS_TERRITORY_BARSTOW},
-	{200, IDS_TERRITORY_SBD},
-	{250, IDS_TERRITORY_BAKERSFIELD},
-	{260, IDS_TERRITORY_ROSEVILLE},
-	}};
-static_assert(std::is_sorted(resourceIDs.cbegin(), resourceIDs.cend()));
+// Powers of ten, indexed by exponent, up to the largest that fits in an int32_t.
+constexpr std::array<uint32_t, 10> powersOfTen{1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
 
-// The loaded string resources, in the same order as resourceIDs.
-constinit std::array<std::unique_ptr<std::wstring>, count> strings;
-}
+// The divisor that reduces a block number with a given number of decimal digits to its first three digits, indexed by digit count.
+constexpr std::array<uint32_t, 11> divisorByDigits{1, 1, 1, 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000};
 }
-
-// Loads the territory name strings.
-void trainlist8::territory::init(HINSTANCE instance) {
-	for(size_t i = 0; i != resourceIDs.size(); ++i) {
-		strings[i].reset(new std::wstring(util::loadString(instance, resourceIDs[i].second)));
-	}
 }
 
 // Returns the ID of a territory for a given block number.
+//
+// The ID is always less than database::territoryIDLimit.
 std::optional<unsigned int> trainlist8::territory::idByBlock(int32_t block) {
 	if(block < 0) {
 		// A block number of −1 means the train is in an unsignalled location.
 		return {};
 	} else {
-		// The first three digits of the block number are the territory; the rest are the block within the territory.
-		unsigned int territory = block;
-		while(territory > 1000) {
-			territory /= 10;
-		}
-		return territory;
+		// The first three digits of the block number are the territory; the rest are the block within the territory. Count the decimal digits by estimating from the bit length (1233/4096 is just over log10(2)) and correcting by one comparison, then strip the extra digits with a single division.
+		uint32_t value = static_cast<uint32_t>(block);
+		unsigned int estimate = static_cast<unsigned int>(std::bit_width(value)) * 1233U >> 12;
+		unsigned int digits = estimate + 1 - (value < powersOfTen[estimate]);
+		return value / divisorByDigits[digits];
 	}
 }
 
-// Returns the ID of a territory in a given position.
-unsigned int trainlist8::territory::idByIndex(size_t index) {
-	return resourceIDs[index].first;
-}
-
-// Returns the position of a territory with a given ID.
-std::optional<size_t> trainlist8::territory::indexByID(unsigned int territory) {
-	auto i = std::lower_bound(resourceIDs.cbegin(), resourceIDs.cend(), territory,
-		[](const std::pair<unsigned int, unsigned int> &candidate, unsigned int target) -> bool {
-			return candidate.first < target;
-		});
-	if(i != resourceIDs.cend() && i->first == territory) {
-		return {i - resourceIDs.cbegin()};
+// Finds the name of a territory in the current database, if known.
+//
+// The returned view is followed by a NUL, and is only valid until the database is next reloaded.
+std::optional<std::wstring_view> trainlist8::territory::nameByID(unsigned int territory) {
+	const database::Database &db = database::current();
+	if(const database::Territory *t = db.territoryByID(territory); t) {
+		return db.name(*t);
 	} else {
 		return {};
 	}
 }
 
-// Returns the name of a territory in a given position.
-const std::wstring *trainlist8::territory::nameByIndex(size_t index) {
-	return strings[index].get();
-}
-
-// Finds the name of a territory, if known, or nullptr if not.
-const std::wstring *trainlist8::territory::nameByID(unsigned int territory) {
-	std::optional<size_t> index = indexByID(territory);
-	if(index) {
-		return strings[*index].get();
+// Returns a number that orders territories the same way as sorting by name does: territories with known names by name, then those without by ID, then unsignalled locations last.
+//
+// The number is less than 2 * database::territoryIDLimit + 1, and is only valid until the database is next reloaded.
+unsigned int trainlist8::territory::sortRank(std::optional<unsigned int> territory) {
+	if(!territory) {
+		return 2 * database::territoryIDLimit;
+	}
+	const database::Database &db = database::current();
+	if(const database::Territory *t = db.territoryByID(*territory); t) {
+		return db.territoryRank(*t);
 	} else {
-		return nullptr;
+		return database::territoryIDLimit + *territory;
 	}
 }
\ No newline at end of file
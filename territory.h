@@ -3,19 +3,14 @@
 #if !defined(TERRITORY_H)
 #define TERRITORY_H
 
-#include <memory>
 #include <optional>
-#include <string>
+#include <string_view>
 
 namespace trainlist8 {
 namespace territory {
-constexpr size_t count = 8;
-void init(HINSTANCE instance);
 std::optional<unsigned int> idByBlock(int32_t block);
-unsigned int idByIndex(size_t index);
-std::optional<size_t> indexByID(unsigned int territory);
-const std::wstring *nameByIndex(size_t index);
-const std::wstring *nameByID(unsigned int territory);
+std::optional<std::wstring_view> nameByID(unsigned int territory);
+unsigned int sortRank(std::optional<unsigned int> territory);
 }
 }
 
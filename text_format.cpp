@@ -0,0 +1,80 @@
+#include "pch.h"
+#include <algorithm>
+#include <cassert>
+#include <locale>
+#include <sstream>
+#include <string>
+#include "text_format.h"
+
+namespace trainlist8 {
+namespace text_format {
+namespace {
+// Obtains a string element of the current locale.
+std::wstring getLocaleString(LCTYPE attribute) {
+	int len = GetLocaleInfoEx(LOCALE_NAME_USER_DEFAULT, attribute, nullptr, 0);
+	if(!len) {
+		winrt::throw_last_error();
+	}
+	std::wstring buffer(len, L'\0');
+	len = GetLocaleInfoEx(LOCALE_NAME_USER_DEFAULT, attribute, buffer.data(), buffer.size());
+	if(!len) {
+		winrt::throw_last_error();
+	}
+	buffer.resize(len);
+	return buffer;
+}
+
+// Obtains an integer element of the current locale.
+DWORD getLocaleInteger(LCTYPE attribute) {
+	DWORD buffer;
+	int len = GetLocaleInfoEx(LOCALE_NAME_USER_DEFAULT, attribute | LOCALE_RETURN_NUMBER, reinterpret_cast<wchar_t *>(&buffer), sizeof(buffer) / sizeof(wchar_t));
+	if(!len) {
+		winrt::throw_last_error();
+	}
+	assert(len * sizeof(wchar_t) == sizeof(buffer));
+	return buffer;
+}
+
+// Obtains the grouping integer for the current locale.
+unsigned int getLocaleGrouping() {
+	// Algorithm from <https://devblogs.microsoft.com/oldnewthing/20060418-11/?p=31493>.
+	std::wstring str = getLocaleString(LOCALE_SGROUPING);
+	std::erase(str, L';');
+	unsigned int ui = static_cast<unsigned int>(std::stoul(str));
+	if(ui % 10) {
+		ui *= 10;
+	} else {
+		ui /= 10;
+	}
+	return ui;
+}
+}
+}
+}
+
+// Returns a number format suitable for formatting numbers.
+NUMBERFMTW trainlist8::text_format::numberFormat(unsigned int decimalPlaces) {
+	static std::wstring decimalSeparator = getLocaleString(LOCALE_SDECIMAL);
+	static std::wstring thousandsSeparator = getLocaleString(LOCALE_STHOUSAND);
+	static NUMBERFMTW base = {
+		.NumDigits = 0,
+		.LeadingZero = getLocaleInteger(LOCALE_ILZERO),
+		.Grouping = getLocaleGrouping(),
+		.lpDecimalSep = const_cast<wchar_t *>(decimalSeparator.c_str()),
+		.lpThousandSep = const_cast<wchar_t *>(thousandsSeparator.c_str()),
+		.NegativeOrder = getLocaleInteger(LOCALE_INEGNUMBER),
+	};
+	NUMBERFMTW ret = base;
+	ret.NumDigits = decimalPlaces;
+	return ret;
+}
+
+// Builds the name of a lead unit from its railroad initials and number, such as "BNSF1234".
+//
+// The number is formatted in the classic locale, because it is part of the unit's name rather than a quantity.
+std::wstring trainlist8::text_format::leadUnit(const wchar_t *railroadInitials, uint32_t locomotiveNumber) {
+	std::wostringstream oss;
+	oss.imbue(std::locale::classic());
+	oss << railroadInitials << locomotiveNumber;
+	return std::move(oss).str();
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#pragma once
+
+#if !defined(TEXT_FORMAT_H)
+#define TEXT_FORMAT_H
+
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <system_error>
+#include "utf8.h"
+
+namespace trainlist8 {
+namespace text_format {
+// Scratch buffers used internally during text formatting.
+struct ScratchBuffers final {
+	// A string buffer.
+	std::string string;
+
+	// A wstring buffer.
+	std::wstring wstring;
+
+	// Another wstring buffer.
+	std::wstring wstring2;
+};
+
+// A type that is either integral or floating-point.
+template<typename T>
+concept Numeric = std::integral<T> || std::floating_point<T>;
+
+NUMBERFMTW numberFormat(unsigned int decimalPlaces);
+std::wstring leadUnit(const wchar_t *railroadInitials, uint32_t locomotiveNumber);
+
+// Formats a number according to the current locale into a buffer.
+//
+// The result is stored in the wstring field of the buffers parameter.
+template<Numeric T>
+void formatNumber(T value, ScratchBuffers &buffers, unsigned int decimalPlaces) {
+	static constexpr size_t startBufferSize = std::numeric_limits<T>::digits10 + 3;
+
+	// Write the value, in locale-agnostic raw format, to buffers.string.
+	{
+		buffers.string.resize(std::max(startBufferSize, buffers.string.capacity()));
+		for(;;) {
+			std::to_chars_result result;
+			if constexpr(std::integral<T>) {
+				result = std::to_chars(buffers.string.data(), buffers.string.data() + buffers.string.size(), value);
+			} else {
+				// GetNumberFormatEx only likes fixed-point, not scientific notation.
+				result = std::to_chars(buffers.string.data(), buffers.string.data() + buffers.string.size(), value, std::chars_format::fixed);
+			}
+			if(result.ec == std::errc()) {
+				buffers.string.resize(result.ptr - buffers.string.data());
+				break;
+			} else if(result.ec == std::errc::value_too_large) {
+				// to_chars does not tell us how much space it wanted, so just try doubling.
+				buffers.string.resize(buffers.string.size() * 2);
+			} else {
+				throw std::system_error(std::make_error_code(result.ec));
+			}
+		}
+	}
+
+	// Convert the multibyte string in buffers.string to a wide string in buffers.wstring2. std::to_chars only ever writes digits, signs and a decimal point, which are all ASCII, so there is no need for a full code page conversion.
+	buffers.wstring2.resize(buffers.string.size());
+	[[maybe_unused]] size_t widened = utf8::widenASCII(reinterpret_cast<const unsigned char *>(buffers.string.data()), buffers.string.size(), buffers.wstring2.data());
+	assert(widened == buffers.string.size());
+
+	// Add proper number formatting.
+	NUMBERFMTW fmt = numberFormat(decimalPlaces);
+	for(;;) {
+		// Optimistically try an initial conversion with a buffer.
+		// Once wstring2 settles to a stable allocation, this will succeed nearly all the time, so is faster.
+		// It's slower (three calls instead of two) when the allocation is too small, but that should be rare.
+		buffers.wstring.resize(std::max(startBufferSize, buffers.wstring.capacity()));
+		int written = GetNumberFormatEx(LOCALE_NAME_USER_DEFAULT, 0, buffers.wstring2.c_str(), &fmt, buffers.wstring.data(), buffers.wstring.size());
+		if(written) {
+			buffers.wstring.resize(written - 1 /* NUL */);
+			break;
+		}
+		if(GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+			winrt::throw_last_error();
+		}
+		// Buffer is too small. Make another call without a buffer, which will tell us how big a buffer is needed.
+		int needed = GetNumberFormatEx(LOCALE_NAME_USER_DEFAULT, 0, buffers.wstring2.c_str(), &fmt, nullptr, 0);
+		if(!needed) {
+			winrt::throw_last_error();
+		}
+		buffers.wstring.resize(needed);
+	}
+}
+}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "pch.h"
+#include <atomic>
+#include <iomanip>
+#include <locale>
+#include <new>
+#include <sstream>
+#include "throughput.h"
+
+using trainlist8::throughput::Sampler;
+
+namespace trainlist8 {
+namespace throughput {
+namespace {
+// A counter, padded to a cache line of its own so that threads incrementing different counters do not contend.
+struct alignas(std::hardware_destructive_interference_size) Slot final {
+	std::atomic<uint64_t> value;
+};
+
+// The counters.
+constinit std::array<Slot, counterCount> slots{};
+
+// The names of the counters, for reports.
+constexpr std::array<const wchar_t *, counterCount> counterNames{
+	L"SendSimulationState",
+	L"UpdateTrainData",
+	L"PermissionUpdate",
+	L"SetOccupiedBlocks",
+	L"SetOccupiedSwitches",
+	L"SetReversedSwitches",
+	L"SetUnlockedSwitches",
+	L"SetSignals",
+	L"DTMF",
+	L"RadioText",
+	L"SetInterlockErrorSwitches",
+	L"Unchanged track state",
+	L"Malformed track state",
+	L"Unchanged train data",
+	L"Folded train data",
+	L"Stale simulation state",
+	L"Shed train data",
+	L"UI flushes",
+	L"Row moves",
+	L"Trains expired",
+};
+}
+}
+}
+
+// Adds to a counter.
+//
+// This may be called from any thread.
+void trainlist8::throughput::add(Counter counter, uint64_t amount) {
+	slots[static_cast<size_t>(counter)].value.fetch_add(amount, std::memory_order_relaxed);
+}
+
+// Returns the total of a counter since the application started.
+uint64_t trainlist8::throughput::total(Counter counter) {
+	return slots[static_cast<size_t>(counter)].value.load(std::memory_order_relaxed);
+}
+
+Sampler::Sampler() :
+	lastTime(std::chrono::steady_clock::now()),
+	lastTotals(),
+	rates() {
+	for(size_t i = 0; i != counterCount; ++i) {
+		lastTotals[i] = total(static_cast<Counter>(i));
+	}
+}
+
+// Reads all the counters and computes their rates since the previous call.
+void Sampler::sample() {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(now - lastTime).count();
+	for(size_t i = 0; i != counterCount; ++i) {
+		uint64_t newTotal = total(static_cast<Counter>(i));
+		rates[i] = seconds > 0 ? static_cast<double>(newTotal - lastTotals[i]) / seconds : 0;
+		lastTotals[i] = newTotal;
+	}
+	lastTime = now;
+}
+
+// Returns the rate of a counter, in events per second, as of the last call to sample.
+double Sampler::rate(Counter counter) const {
+	return rates[static_cast<size_t>(counter)];
+}
+
+// Formats a human-readable list of all the counters' rates and totals.
+std::wstring Sampler::report() const {
+	std::wostringstream oss;
+	oss.imbue(std::locale::classic());
+	oss << std::fixed << std::setprecision(1);
+	oss << std::left << std::setw(29) << L"Counter" << std::right << std::setw(10) << L"Per second" << std::setw(14) << L"Total" << L"\r\n";
+	for(size_t i = 0; i != counterCount; ++i) {
+		oss << std::left << std::setw(29) << counterNames[i] << std::right << std::setw(10) << rates[i] << std::setw(14) << lastTotals[i] << L"\r\n";
+	}
+	return std::move(oss).str();
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#if !defined(THROUGHPUT_H)
+#define THROUGHPUT_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace trainlist8 {
+namespace throughput {
+// The events that are counted.
+enum class Counter {
+	// Messages received, by action, in the same order as the message descriptions passed to WsReceiveMessage.
+	SEND_SIMULATION_STATE_MESSAGES,
+	UPDATE_TRAIN_DATA_MESSAGES,
+	PERMISSION_UPDATE_MESSAGES,
+	SET_OCCUPIED_BLOCKS_MESSAGES,
+	SET_OCCUPIED_SWITCHES_MESSAGES,
+	SET_REVERSED_SWITCHES_MESSAGES,
+	SET_UNLOCKED_SWITCHES_MESSAGES,
+	SET_SIGNALS_MESSAGES,
+	DTMF_MESSAGES,
+	RADIO_TEXT_MESSAGES,
+	SET_INTERLOCK_ERROR_SWITCHES_MESSAGES,
+
+	// Track state messages that changed nothing and were therefore discarded.
+	UNCHANGED_TRACK_STATE_MESSAGES,
+
+	// Track state messages with a route or ID beyond TrackState's limits, which were therefore discarded.
+	MALFORMED_TRACK_STATE_MESSAGES,
+
+	// Train data messages identical to the previous one for the same train, whose fields were therefore not compared.
+	UNCHANGED_TRAIN_DATA_MESSAGES,
+
+	// Train data messages replaced by a later one for the same train before the UI thread got round to applying them.
+	FOLDED_TRAIN_DATA_MESSAGES,
+
+	// Simulation state messages replaced by a later one from the same server before the UI thread got round to applying them.
+	STALE_SIMULATION_STATE_MESSAGES,
+
+	// Train data messages dropped because too many trains already had updates waiting for the UI thread.
+	SHED_TRAIN_DATA_MESSAGES,
+
+	// Times the UI thread flushed the queued ticks and train updates.
+	UI_FLUSHES,
+
+	// Times an existing train's row was moved to a new position in the list.
+	ROW_MOVES,
+
+	// Trains removed because no update was received for them for too long.
+	TRAINS_EXPIRED,
+};
+
+// The number of elements in Counter.
+constexpr size_t counterCount = static_cast<size_t>(Counter::TRAINS_EXPIRED) + 1;
+
+// The number of elements in Counter that count messages by action.
+constexpr size_t actionCounterCount = static_cast<size_t>(Counter::SET_INTERLOCK_ERROR_SWITCHES_MESSAGES) + 1;
+
+void add(Counter counter, uint64_t amount = 1);
+uint64_t total(Counter counter);
+
+// Computes the rate of each counter over the interval between successive calls to sample.
+class Sampler final {
+	public:
+	explicit Sampler();
+
+	void sample();
+	double rate(Counter counter) const;
+	std::wstring report() const;
+
+	private:
+	// When sample was last called.
+	std::chrono::steady_clock::time_point lastTime;
+
+	// The counter totals when sample was last called.
+	std::array<uint64_t, counterCount> lastTotals;
+
+	// The rates, in events per second, computed by the last call to sample.
+	std::array<double, counterCount> rates;
+};
+}
+}
+
+#endif
\ No newline at end of file
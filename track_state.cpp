@@ -0,0 +1,98 @@
+#include "pch.h"
+#include <algorithm>
+#include <cassert>
+#include <string_view>
+#include <utility>
+#include "soap.h"
+#include "track_state.h"
+
+using trainlist8::TrackState;
+
+namespace trainlist8 {
+namespace {
+// The number of IDs stored in each word of a bit table.
+constexpr size_t bitsPerWord = 64;
+
+// Converts the name of a signal indication, as sent by Run 8, to a SignalIndication.
+TrackState::SignalIndication parseSignalIndication(const WS_XML_STRING &name) {
+	using namespace std::literals;
+	static constexpr std::array<std::pair<std::string_view, TrackState::SignalIndication>, 4> names{{
+		{"Stop"sv, TrackState::SignalIndication::STOP},
+		{"Proceed"sv, TrackState::SignalIndication::PROCEED},
+		{"Fleet"sv, TrackState::SignalIndication::FLEET},
+		{"FlagBy"sv, TrackState::SignalIndication::FLAG_BY},
+	}};
+	std::string_view view(reinterpret_cast<const char *>(name.bytes), name.length);
+	for(const auto &i : names) {
+		if(i.first == view) {
+			return i.second;
+		}
+	}
+	return TrackState::SignalIndication::UNKNOWN;
+}
+}
+}
+
+// Applies a SetOccupiedBlocks message.
+TrackState::Result TrackState::apply(const soap::OccupiedBlocks &message) {
+	if(message.route < 0 || message.route >= routeLimit || !idsInRange(std::span(message.occupiedBlocks, message.occupiedBlockCount)) || !idsInRange(std::span(message.openManualSwitchBlocks, message.openManualSwitchBlockCount))) {
+		return Result::MALFORMED;
+	}
+	Route &route = routes[message.route];
+	bool changed = replaceBits(route.bits[static_cast<size_t>(Table::OCCUPIED_BLOCKS)], std::span(message.occupiedBlocks, message.occupiedBlockCount));
+	changed |= replaceBits(route.bits[static_cast<size_t>(Table::OPEN_MANUAL_SWITCH_BLOCKS)], std::span(message.openManualSwitchBlocks, message.openManualSwitchBlockCount));
+	return changed ? Result::CHANGED : Result::UNCHANGED;
+}
+
+// Applies a SetOccupiedSwitches, SetReversedSwitches, or SetUnlockedSwitches message to the given table.
+TrackState::Result TrackState::apply(Table table, const soap::SwitchList &message) {
+	assert(table == Table::OCCUPIED_SWITCHES || table == Table::REVERSED_SWITCHES || table == Table::UNLOCKED_SWITCHES);
+	if(message.route < 0 || message.route >= routeLimit || !idsInRange(std::span(message.switches, message.switchCount))) {
+		return Result::MALFORMED;
+	}
+	return replaceBits(routes[message.route].bits[static_cast<size_t>(table)], std::span(message.switches, message.switchCount)) ? Result::CHANGED : Result::UNCHANGED;
+}
+
+// Applies a SetSignals message.
+TrackState::Result TrackState::apply(const soap::Signals &message) {
+	if(message.route < 0 || message.route >= routeLimit || message.indicationCount > static_cast<unsigned long>(idLimit)) {
+		return Result::MALFORMED;
+	}
+	std::vector<SignalIndication> &table = routes[message.route].signals;
+
+	// Decode the new indications. Signals beyond the end of the shorter of the old and new tables compare against UNKNOWN.
+	signalScratch.resize(message.indicationCount);
+	std::ranges::transform(std::span(message.indications, message.indicationCount), signalScratch.begin(), &parseSignalIndication);
+	size_t size = std::max(table.size(), signalScratch.size());
+	table.resize(size, SignalIndication::UNKNOWN);
+	signalScratch.resize(size, SignalIndication::UNKNOWN);
+	bool changed = table != signalScratch;
+	table.swap(signalScratch);
+	return changed ? Result::CHANGED : Result::UNCHANGED;
+}
+
+// Returns whether every ID in a list is less than idLimit. Negative IDs are allowed, because they are ignored.
+bool TrackState::idsInRange(std::span<const int32_t> ids) {
+	return std::ranges::all_of(ids, [](int32_t id) { return id < idLimit; });
+}
+
+// Replaces the contents of a bit table with a new set of IDs, returning whether the state of any ID changed.
+bool TrackState::replaceBits(std::vector<uint64_t> &table, std::span<const int32_t> ids) {
+	// Build the new table in the scratch buffer, making it at least as long as the old one so the two can be compared word by word.
+	scratch.assign(table.size(), 0);
+	for(int32_t id : ids) {
+		if(id >= 0) {
+			size_t word = static_cast<size_t>(id) / bitsPerWord;
+			if(word >= scratch.size()) {
+				scratch.resize(word + 1, 0);
+			}
+			scratch[word] |= uint64_t{1} << (static_cast<size_t>(id) % bitsPerWord);
+		}
+	}
+	table.resize(scratch.size(), 0);
+	bool changed = table != scratch;
+
+	// The new table becomes the current one; the old table's storage becomes the next scratch buffer.
+	table.swap(scratch);
+	return changed;
+}
\ No newline at end of file
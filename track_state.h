@@ -0,0 +1,106 @@
+#pragma once
+
+#if !defined(TRACK_STATE_H)
+#define TRACK_STATE_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace trainlist8 {
+namespace soap {
+struct OccupiedBlocks;
+struct Signals;
+struct SwitchList;
+}
+
+// The state of the blocks, switches, and signals in all routes, as most recently reported by Run 8.
+//
+// Run 8 always sends the complete state of one table for one route in each message. This class keeps the previous state of each table so that, when a new message arrives, it can report whether anything actually changed. Nothing displays the state yet, so that is all it reports.
+class TrackState final {
+	public:
+	// The tables of per-ID state that are kept for each route.
+	enum class Table {
+		// Blocks that are occupied by a train.
+		OCCUPIED_BLOCKS,
+
+		// Blocks that contain a hand-thrown switch not lined for the main track.
+		OPEN_MANUAL_SWITCH_BLOCKS,
+
+		// Switches that are occupied by a train.
+		OCCUPIED_SWITCHES,
+
+		// Switches that are reversed.
+		REVERSED_SWITCHES,
+
+		// Switches that are unlocked.
+		UNLOCKED_SWITCHES,
+
+		// Signals, whose state is an indication rather than a single bit.
+		SIGNALS,
+	};
+
+	// The number of elements in Table.
+	static constexpr size_t tableCount = static_cast<size_t>(Table::SIGNALS) + 1;
+
+	// Route IDs are territory IDs, which are three digits, so they are always less than this.
+	static constexpr int32_t routeLimit = 1000;
+
+	// Block and switch numbers within a route, and signal indices, are always less than this. Run 8's own numbers are far smaller; the limit is only there because each table holds one entry per number up to the highest seen, so a single bad number could otherwise make a table enormous.
+	static constexpr int32_t idLimit = 1 << 20;
+
+	// The indications a signal can display.
+	enum class SignalIndication : uint8_t {
+		// The indication was not sent, or was sent but is not one this application knows about.
+		UNKNOWN,
+		STOP,
+		PROCEED,
+		FLEET,
+		FLAG_BY,
+	};
+
+	// The outcome of applying a message.
+	enum class Result {
+		// The route or an ID was beyond its limit, so the message was discarded.
+		MALFORMED,
+
+		// The message repeated the state already held.
+		UNCHANGED,
+
+		// The message changed the state of at least one ID.
+		CHANGED,
+	};
+
+	explicit TrackState() = default;
+
+	Result apply(const soap::OccupiedBlocks &message);
+	Result apply(Table table, const soap::SwitchList &message);
+	Result apply(const soap::Signals &message);
+
+	private:
+	// The state of a single route.
+	struct Route final {
+		// For each bit table, one bit per ID, packed into 64-bit words.
+		std::array<std::vector<uint64_t>, tableCount - 1> bits;
+
+		// The indication displayed by each signal, indexed by signal number.
+		std::vector<SignalIndication> signals;
+	};
+
+	// The routes, keyed by route ID.
+	std::unordered_map<int32_t, Route> routes;
+
+	// A buffer used to build the new contents of a bit table before comparing it against the old contents.
+	std::vector<uint64_t> scratch;
+
+	// A buffer used to build the new contents of a signal table before comparing it against the old contents.
+	std::vector<SignalIndication> signalScratch;
+
+	static bool idsInRange(std::span<const int32_t> ids);
+	bool replaceBits(std::vector<uint64_t> &table, std::span<const int32_t> ids);
+};
+}
+
+#endif
\ No newline at end of file
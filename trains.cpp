@@ -0,0 +1,29 @@
+#include "pch.h"
+#include "territory.h"
+#include "trains.h"
+
+// Builds a train's sort key from its territory, location and the first character of its symbol.
+//
+// Each part is ranked the same way as its column sorts, so comparing two keys gives the same answer as comparing the columns in turn, except that the rest of the symbols must still be compared when the keys are equal.
+uint64_t trainlist8::trains::sortKey(const MainWindow::TrainInfo &train) {
+	uint64_t territoryPart = territory::sortRank(train.territory);
+	uint64_t blockPart = static_cast<uint32_t>(train.block) ^ 0x80000000U;
+	uint64_t symbolPart = train.symbol.empty() ? 0 : static_cast<uint16_t>(train.symbol[0]);
+	return territoryPart << 48 | blockPart << 16 | symbolPart;
+}
+
+// Compares two trains that are equal in the column the list is sorted by.
+//
+// Trains are ordered by territory, location and symbol, then by server and ID, in ascending order whichever way the list is sorted. No two trains compare equal, so trains with the same value in the sort column keep a fixed order instead of trading places as they are updated. The trains' sortKey members must be up to date.
+int trainlist8::trains::compareTies(const MainWindow::TrainInfo &x, const MainWindow::TrainInfo &y) {
+	if(x.sortKey != y.sortKey) {
+		return x.sortKey < y.sortKey ? -1 : 1;
+	}
+	if(int ret = x.symbol.compare(y.symbol); ret) {
+		return ret;
+	}
+	if(x.server != y.server) {
+		return x.server < y.server ? -1 : 1;
+	}
+	return x.id < y.id ? -1 : x.id > y.id ? 1 : 0;
+}
\ No newline at end of file
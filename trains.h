@@ -0,0 +1,36 @@
+#pragma once
+
+#if !defined(TRAINS_H)
+#define TRAINS_H
+
+#include <cstdint>
+#include <unordered_map>
+#include "main_window.h"
+
+namespace trainlist8 {
+namespace trains {
+// The age threshold above which trains are removed.
+constexpr unsigned int ageThreshold = 5;
+
+uint64_t sortKey(const MainWindow::TrainInfo &train);
+int compareTies(const MainWindow::TrainInfo &x, const MainWindow::TrainInfo &y);
+
+// Ages the trains on one server by a number of simulation state messages, removing those over the threshold.
+//
+// The expired callback is called with each train just before it is removed.
+template<typename F>
+void age(std::unordered_map<uint64_t, MainWindow::TrainInfo> &trains, size_t server, unsigned int count, F &&expired) {
+	for(auto i = trains.begin(); i != trains.end();) {
+		MainWindow::TrainInfo &train = i->second;
+		if(train.server == server && (train.age += count) > ageThreshold) {
+			expired(train);
+			i = trains.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
+}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "pch.h"
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#include "utf8.h"
+
+// Widens the leading run of ASCII characters in a UTF-8 string to UTF-16, stopping at the first byte that is not ASCII.
+//
+// Each converted byte becomes one wchar_t at the same index in dest, and the number converted is returned; the caller can hand whatever is left to a general-purpose converter. Strings from Run 8 are nearly always entirely ASCII, so on x86 the bytes are checked and widened sixteen, then eight, at a time using SSE2, which every processor able to run Windows 10 has.
+size_t trainlist8::utf8::widenASCII(const unsigned char *source, size_t length, wchar_t *dest) {
+	size_t i = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	static_assert(sizeof(wchar_t) == 2);
+	const __m128i zero = _mm_setzero_si128();
+	for(; length - i >= 16; i += 16) {
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+		if(_mm_movemask_epi8(bytes)) {
+			break;
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), _mm_unpacklo_epi8(bytes, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i + 8), _mm_unpackhi_epi8(bytes, zero));
+	}
+	if(length - i >= 8) {
+		__m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(source + i));
+		if(!(_mm_movemask_epi8(bytes) & 0xFF)) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), _mm_unpacklo_epi8(bytes, zero));
+			i += 8;
+		}
+	}
+#endif
+	for(; i != length && source[i] < 0x80; ++i) {
+		dest[i] = source[i];
+	}
+	return i;
+}
\ No newline at end of file
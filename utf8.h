@@ -0,0 +1,15 @@
+#pragma once
+
+#if !defined(UTF8_H)
+#define UTF8_H
+
+#include <cstddef>
+
+namespace trainlist8 {
+namespace utf8 {
+// Widens the leading run of ASCII characters in a UTF-8 string to UTF-16, stopping at the first byte that is not ASCII.
+size_t widenASCII(const unsigned char *source, size_t length, wchar_t *dest);
+}
+}
+
+#endif
\ No newline at end of file
@@ -7,12 +7,20 @@
 #include "error.h"
 #include "main_window.h"
 #include "resource.h"
+#include "startup.h"
 #include "util.h"
 #include "welcome_window.h"
 
 using trainlist8::WelcomeWindow;
 using trainlist8::util::operator ""_as_xml;
 
+namespace trainlist8 {
+namespace {
+// The characters that separate hostnames in the hostname field.
+constexpr std::wstring_view hostnameSeparators = L",; \t\r\n";
+}
+}
+
 constinit const wchar_t WelcomeWindow::windowClass[] = L"welcome";
 
 WelcomeWindow::WelcomeWindow(HWND handle, MessagePump &pump, const wchar_t *connectTo) :
@@ -24,8 +32,11 @@ WelcomeWindow::WelcomeWindow(HWND handle, MessagePump &pump, const wchar_t *conn
 	hostnameEdit(util::createWindowEx(0, WC_EDITW, L"", ES_AUTOHSCROLL | ES_LEFT | ES_LOWERCASE | WS_BORDER | WS_CHILD | WS_TABSTOP | WS_VISIBLE, 0, 0, 0, 0, *this, nullptr, instance(), nullptr)),
 	connectButton(util::createWindowEx(0, WC_BUTTONW, util::loadString(instance(), IDS_WELCOME_CONNECT).c_str(), BS_CENTER | BS_DEFPUSHBUTTON | BS_PUSHBUTTON | BS_TEXT | BS_VCENTER | WS_CHILD | WS_TABSTOP | WS_VISIBLE, 0, 0, 0, 0, *this, nullptr, instance(), nullptr)),
 	cancelButton(util::createWindowEx(0, WC_BUTTONW, util::loadString(instance(), IDS_CANCEL).c_str(), BS_CENTER | BS_PUSHBUTTON | BS_TEXT | BS_VCENTER | WS_CHILD | WS_TABSTOP | WS_VISIBLE, 0, 0, 0, 0, *this, nullptr, instance(), nullptr)),
-	connection(),
+	connections(),
 	connecting(),
+	pendingConnections(0),
+	connectStatus(winrt::Windows::Foundation::AsyncStatus::Completed),
+	connectError(),
 	cancelling(false),
 	closePending(false),
 	quitOnDestroy(true) {
@@ -51,14 +62,12 @@ WelcomeWindow::WelcomeWindow(HWND handle, MessagePump &pump, const wchar_t *conn
 LRESULT WelcomeWindow::windowProc(unsigned int message, WPARAM wParam, LPARAM lParam) {
 	switch(message) {
 		case WM_CLOSE:
-			if(connecting) {
+			if(!connecting.empty()) {
 				if(cancelling) {
 					closePending = true;
 				} else {
 					closePending = true;
-					connecting.Cancel();
-					cancelling = true;
-					updateControlsEnabled();
+					cancelConnecting();
 				}
 			} else {
 				DestroyWindow(*this);
@@ -85,10 +94,8 @@ LRESULT WelcomeWindow::windowProc(unsigned int message, WPARAM wParam, LPARAM lP
 				}
 			} else if(control == cancelButton) {
 				if(HIWORD(wParam) == BN_CLICKED) {
-					assert(connecting);
-					connecting.Cancel();
-					cancelling = true;
-					updateControlsEnabled();
+					assert(!connecting.empty());
+					cancelConnecting();
 					return 0;
 				}
 			}
@@ -144,23 +151,24 @@ void WelcomeWindow::updateLayoutAndFont() {
 }
 
 void WelcomeWindow::updateControlsEnabled() {
-	EnableWindow(localhostRadio, !connecting);
-	EnableWindow(otherComputerRadio, !connecting);
-	EnableWindow(hostnameEdit, !connecting && Button_GetCheck(otherComputerRadio) == BST_CHECKED);
-	EnableWindow(connectButton, !connecting && (Button_GetCheck(localhostRadio) == BST_CHECKED || Edit_GetTextLength(hostnameEdit) != 0));
-	EnableWindow(cancelButton, !!connecting && !cancelling);
+	bool idle = connecting.empty();
+	EnableWindow(localhostRadio, idle);
+	EnableWindow(otherComputerRadio, idle);
+	EnableWindow(hostnameEdit, idle && Button_GetCheck(otherComputerRadio) == BST_CHECKED);
+	EnableWindow(connectButton, idle && (Button_GetCheck(localhostRadio) == BST_CHECKED || Edit_GetTextLength(hostnameEdit) != 0));
+	EnableWindow(cancelButton, !idle && !cancelling);
 }
 
 void WelcomeWindow::connect() {
 	auto uiThread = winrt::Windows::System::DispatcherQueue::GetForCurrentThread();
 
 	// Sanity check: the connect button should be disabled while a connection is in progress.
-	assert(!connecting);
+	assert(connecting.empty());
 
-	// Determine the host the user wants to connect to.
-	winrt::hstring hostname;
+	// Determine the hosts the user wants to connect to.
+	std::vector<winrt::hstring> hostnames;
 	if(Button_GetCheck(localhostRadio) == BST_CHECKED) {
-		hostname = L"localhost";
+		hostnames.emplace_back(L"localhost");
 	} else {
 		SetLastError(0);
 		int len = GetWindowTextLengthW(hostnameEdit);
@@ -174,65 +182,118 @@ void WelcomeWindow::connect() {
 			winrt::throw_last_error();
 		}
 		buffer.resize(len);
-		hostname = buffer;
+
+		// Several hosts may be given, separated by commas, semicolons, or whitespace.
+		std::wstring_view remaining(buffer);
+		for(;;) {
+			size_t start = remaining.find_first_not_of(hostnameSeparators);
+			if(start == std::wstring_view::npos) {
+				break;
+			}
+			remaining.remove_prefix(start);
+			size_t end = std::min(remaining.find_first_of(hostnameSeparators), remaining.size());
+			hostnames.emplace_back(remaining.substr(0, end));
+			remaining.remove_prefix(end);
+		}
+		if(hostnames.empty()) {
+			// The field contains only separators.
+			return;
+		}
+	}
+
+	// Start the background operations. The Connection objects are all constructed before any operation starts, because they must not move while their operations are in progress.
+	connections.resize(hostnames.size());
+	pendingConnections = hostnames.size();
+	connectStatus = winrt::Windows::Foundation::AsyncStatus::Completed;
+	connectError = {};
+	for(size_t i = 0; i != hostnames.size(); ++i) {
+		connecting.push_back(connections[i].connect(std::move(hostnames[i])));
 	}
 
-	// Start the background operation.
-	connection.emplace();
-	connecting = connection->connect(std::move(hostname));
+	// Disable the controls while the connection operations are in progress.
+	updateControlsEnabled();
+
+	// Register for notification of completion of the operations.
+	for(const winrt::Windows::Foundation::IAsyncAction &i : connecting) {
+		i.Completed([this, uiThread](const winrt::Windows::Foundation::IAsyncAction &action, winrt::Windows::Foundation::AsyncStatus status) {
+			// See what happened.
+			winrt::hresult_error error;
+			try {
+				action.GetResults();
+			} catch(const winrt::hresult_canceled &) {
+				// The connection request was cancelled, either by the user clicking the cancel button or the window close button, or because a connection to another host failed.
+			} catch(const winrt::hresult_error &err) {
+				// The connection attempt failed.
+				error = err;
+			}
+
+			// Dispatch on the UI thread to deal with the result.
+			winrt::check_bool(uiThread.TryEnqueue([this, status, error]() {
+				handleConnectFinished(status, error);
+				}));
+			});
+	}
+}
 
-	// Disable the controls while the connection operation is in progress.
+// Cancels all the connection operations that are in progress.
+void WelcomeWindow::cancelConnecting() {
+	for(const winrt::Windows::Foundation::IAsyncAction &i : connecting) {
+		i.Cancel();
+	}
+	cancelling = true;
 	updateControlsEnabled();
+}
 
-	// Register for notification of completion of the operation.
-	connecting.Completed([this, uiThread](const winrt::Windows::Foundation::IAsyncAction &action, winrt::Windows::Foundation::AsyncStatus status) {
-		// See what happened.
-		winrt::hresult_error error;
-		try {
-			action.GetResults();
-		} catch(const winrt::hresult_canceled &) {
-			// The connection request was cancelled by the user, by clicking either the cancel button or the window close button.
-		} catch(const winrt::hresult_error &err) {
-			// The connection attempt failed.
-			error = err;
+// Handles the completion of one connection operation.
+//
+// Nothing happens until every operation has finished. The main window is opened only if every connection succeeded; otherwise the first failure is reported.
+void WelcomeWindow::handleConnectFinished(winrt::Windows::Foundation::AsyncStatus status, const winrt::hresult_error &error) {
+	// Remember the first failure. The other connections are now useless, so stop them.
+	if(status != winrt::Windows::Foundation::AsyncStatus::Completed && connectStatus == winrt::Windows::Foundation::AsyncStatus::Completed) {
+		connectStatus = status;
+		connectError = error;
+		if(!cancelling) {
+			cancelConnecting();
 		}
+	}
+	if(--pendingConnections) {
+		return;
+	}
 
-		// Dispatch on the UI thread to deal with the result.
-		winrt::check_bool(uiThread.TryEnqueue([this, status, error]() {
-			// Report the error (if appropriate) and clean up state.
-			switch(status) {
-				case winrt::Windows::Foundation::AsyncStatus::Completed:
-				{
-					// Callables pointed to by std::function must be copyable. Connection is not copyable, nor is unique_ptr<Connection>.
-					std::shared_ptr<Connection> connection = std::make_shared<Connection>(std::move(*this->connection));
-					HWND mainWindowHandle = trainlist8::Window::create(WS_EX_WINDOWEDGE, MainWindow::windowClass, trainlist8::util::loadString(instance(), IDS_APP_NAME).c_str(), WS_CAPTION | WS_MAXIMIZEBOX | WS_MINIMIZEBOX | WS_OVERLAPPED | WS_SIZEBOX | WS_SYSMENU, CW_USEDEFAULT, 0, 1000, 500, nullptr, nullptr, instance(), [connection = std::move(connection), &pump = pump](HWND handle) mutable {
-						assert(connection.use_count() == 1);
-						return new trainlist8::MainWindow(handle, pump, std::forward<Connection &&>(*connection));
-					});
-					winrt::check_bool(ShowWindowAsync(mainWindowHandle, SW_SHOWDEFAULT));
-					quitOnDestroy = false;
-					DestroyWindow(*this);
-				}
-				return;
-
-				case winrt::Windows::Foundation::AsyncStatus::Canceled:
-					break;
-
-				case winrt::Windows::Foundation::AsyncStatus::Error:
-					if(error.code() == error::noDispatcherPermission) {
-						MessageBoxW(*this, util::loadString(instance(), IDS_WELCOME_NO_PERMISSION).c_str(), util::loadString(instance(), IDS_APP_NAME).c_str(), MB_OK | MB_ICONHAND);
-					} else {
-						MessageBoxW(*this, util::loadAndFormatString(instance(), IDS_WELCOME_CONNECTION_ERROR, error.message().c_str()).c_str(), util::loadString(instance(), IDS_APP_NAME).c_str(), MB_OK | MB_ICONHAND);
-					}
-					break;
-			}
-			connection.reset();
-			connecting = {};
-			cancelling = false;
-			updateControlsEnabled();
-			if(closePending) {
-				DestroyWindow(*this);
+	// Report the error (if appropriate) and clean up state.
+	switch(connectStatus) {
+		case winrt::Windows::Foundation::AsyncStatus::Completed:
+		{
+			// Callables pointed to by std::function must be copyable. Connection is not copyable, nor is a vector of them.
+			startup::mark("Connected");
+			std::shared_ptr<std::vector<Connection>> connections = std::make_shared<std::vector<Connection>>(std::move(this->connections));
+			HWND mainWindowHandle = trainlist8::Window::create(WS_EX_WINDOWEDGE, MainWindow::windowClass, trainlist8::util::loadString(instance(), IDS_APP_NAME).c_str(), WS_CAPTION | WS_MAXIMIZEBOX | WS_MINIMIZEBOX | WS_OVERLAPPED | WS_SIZEBOX | WS_SYSMENU, CW_USEDEFAULT, 0, 1000, 500, nullptr, nullptr, instance(), [connections = std::move(connections), &pump = pump](HWND handle) mutable {
+				assert(connections.use_count() == 1);
+				return new trainlist8::MainWindow(handle, pump, std::move(*connections));
+			});
+			winrt::check_bool(ShowWindowAsync(mainWindowHandle, SW_SHOWDEFAULT));
+			startup::mark("MainWindow");
+			quitOnDestroy = false;
+			DestroyWindow(*this);
+		}
+		return;
+
+		case winrt::Windows::Foundation::AsyncStatus::Canceled:
+			break;
+
+		case winrt::Windows::Foundation::AsyncStatus::Error:
+			if(connectError.code() == error::noDispatcherPermission) {
+				MessageBoxW(*this, util::loadString(instance(), IDS_WELCOME_NO_PERMISSION).c_str(), util::loadString(instance(), IDS_APP_NAME).c_str(), MB_OK | MB_ICONHAND);
+			} else {
+				MessageBoxW(*this, util::loadAndFormatString(instance(), IDS_WELCOME_CONNECTION_ERROR, connectError.message().c_str()).c_str(), util::loadString(instance(), IDS_APP_NAME).c_str(), MB_OK | MB_ICONHAND);
 			}
-			}));
-		});
+			break;
+	}
+	connections.clear();
+	connecting.clear();
+	cancelling = false;
+	updateControlsEnabled();
+	if(closePending) {
+		DestroyWindow(*this);
+	}
 }
\ No newline at end of file
@@ -4,7 +4,7 @@
 #define WELCOME_WINDOW_H
 
 #include <memory>
-#include <optional>
+#include <vector>
 #include "connection.h"
 #include "util.h"
 #include "window.h"
@@ -30,13 +30,18 @@ class WelcomeWindow final : public Window {
 	HWND hostnameEdit;
 	HWND connectButton;
 	HWND cancelButton;
-	std::optional<Connection> connection;
-	winrt::Windows::Foundation::IAsyncAction connecting;
+	std::vector<Connection> connections;
+	std::vector<winrt::Windows::Foundation::IAsyncAction> connecting;
+	size_t pendingConnections;
+	winrt::Windows::Foundation::AsyncStatus connectStatus;
+	winrt::hresult_error connectError;
 	bool cancelling, closePending, quitOnDestroy;
 
 	void updateLayoutAndFont();
 	void updateControlsEnabled();
 	void connect();
+	void cancelConnecting();
+	void handleConnectFinished(winrt::Windows::Foundation::AsyncStatus status, const winrt::hresult_error &error);
 };
 }
 